@@ -0,0 +1,20 @@
+#version 330 core
+
+in vec4 rgbaColor;
+in vec2 tile;
+flat in vec2 texOrigin;
+flat in vec2 texStepA;
+flat in vec2 texStepB;
+
+out vec4 color;
+
+uniform sampler2D meshTexture;
+
+void main()
+{
+    // Merged faces span several cells, so repeat the face's part of the texture once per cell.
+    vec2 cell = fract(tile);
+    vec2 texCoords = texOrigin + cell.x * texStepA + cell.y * texStepB;
+
+    color = rgbaColor * texture(meshTexture, texCoords);
+}
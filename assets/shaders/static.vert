@@ -0,0 +1,27 @@
+#version 330
+
+layout (location = 0) in vec3 vertPosCoords;
+layout (location = 1) in vec4 vertRgbaColor;
+layout (location = 2) in vec2 vertTile;
+layout (location = 3) in vec2 vertTexOrigin;
+layout (location = 4) in vec2 vertTexStepA;
+layout (location = 5) in vec2 vertTexStepB;
+
+out vec4 rgbaColor;
+out vec2 tile;
+flat out vec2 texOrigin;
+flat out vec2 texStepA;
+flat out vec2 texStepB;
+
+uniform mat4 MVP;
+
+void main()
+{
+    rgbaColor = vertRgbaColor;
+    tile = vertTile;
+    texOrigin = vertTexOrigin;
+    texStepA = vertTexStepA;
+    texStepB = vertTexStepB;
+    
+    gl_Position = MVP * vec4(vertPosCoords, 1.0);
+}
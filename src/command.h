@@ -0,0 +1,61 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+#include "entity.h"
+
+class ECS;
+class Component;
+
+enum class CommandType { createEntity, addComponent, removeComponent, destroyEntity };
+
+struct EntityCommand
+{
+	CommandType type;
+	EntityHandle entity;	// A pending handle for entities created earlier in the same buffer.
+
+	Component* component = nullptr;
+	int componentID = 0;
+
+	int scene = 0;
+	std::string name;
+};
+
+// Structural changes (creating and destroying entities, adding and removing components)
+// recorded from any thread while systems run, then applied together at one sync point
+// in ECS::Update, where nothing else is touching the entity table or the queries.
+//
+// Playback runs creations first, then each entity's commands in the order they were
+// recorded, entity by entity, so the result doesn't depend on how the threads' commands
+// interleaved. Destroying the same entity twice, or one that is already gone, is harmless.
+class CommandBuffer
+{
+public:
+	// The handle returned here only means something to this buffer until playback;
+	// use it to queue components onto the new entity.
+	EntityHandle CreateEntity(int scene, std::string name);
+	void DestroyEntity(EntityHandle entity);
+	void AddComponent(EntityHandle entity, Component* component);
+	void RemoveComponent(EntityHandle entity, int componentID);
+
+	void Playback(ECS& ecs);
+
+	static bool IsPending(EntityHandle handle)
+	{
+		// Live entities start at generation 1, so generation 0 is free to mark pending ones.
+		return !handle.IsNull() && handle.Generation() == 0;
+	}
+
+private:
+	std::mutex mutex;
+	std::vector<EntityCommand> commands;
+	uint32_t pendingCount = 0;
+
+	void Record(EntityCommand command);
+};
+
+#endif
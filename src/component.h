@@ -8,117 +8,95 @@
 #include "texture.h"
 #include "animation.h"
 #include "model.h"
-
-class Entity;
-
-static int positionComponentID				= 1;
-static int cubeComponentID					= 2;
-static int animationComponentID				= 3;
-static int animationControllerComponentID	= 4;
-static int inputComponentID					= 5;
-static int cameraFollowComponentID			= 6;
-static int billboardingComponentID			= 7;
-static int actorComponentID					= 8;
-static int movementComponentID				= 9;
-static int modelComponentID					= 10;
-
-static int playerAnimControllerSubID		= 1;
-
-class Component
+#include "entity.h"
+#include "pool.h"
+
+class PositionComponent;
+class CubeComponent;
+class AnimationComponent;
+class AnimationControllerComponent;
+class InputComponent;
+class CameraFollowComponent;
+class BillboardingComponent;
+class ActorComponent;
+class MovementComponent;
+class ModelComponent;
+
+template <typename... Ts>
+struct TypeList {};
+
+// Every component type, in ID order.
+// A new component only needs to be appended here to get an ID.
+using ComponentTypes = TypeList<
+	PositionComponent,
+	CubeComponent,
+	AnimationComponent,
+	AnimationControllerComponent,
+	InputComponent,
+	CameraFollowComponent,
+	BillboardingComponent,
+	ActorComponent,
+	MovementComponent,
+	ModelComponent>;
+
+template <typename T, typename List>
+struct TypeIndex;
+
+template <typename T, typename... Ts>
+struct TypeIndex<T, TypeList<T, Ts...>>
 {
-public:
-	bool active;
-	Entity* entity;
-	int ID;
+	static constexpr int value = 0;
 };
 
-struct Quaternion
+template <typename T, typename U, typename... Ts>
+struct TypeIndex<T, TypeList<U, Ts...>>
 {
-	float w;
-	float x;
-	float y;
-	float z;
-
-	Quaternion operator*(const Quaternion& rhs) const noexcept
-	{
-		Quaternion q = { 0, 0, 0, 0 };
-		q.w = (this->w * rhs.w - this->x * rhs.x - this->y * rhs.y - this->z * rhs.z);
-		q.x = (this->w * rhs.x + this->x * rhs.w + this->y * rhs.z - this->z * rhs.y);
-		q.y = (this->w * rhs.y - this->x * rhs.z + this->y * rhs.w + this->z * rhs.x);
-		q.z = (this->w * rhs.z + this->x * rhs.y - this->y * rhs.x + this->z * rhs.w);
-		return q;
-	}
+	static constexpr int value = 1 + TypeIndex<T, TypeList<Ts...>>::value;
+};
 
-	bool operator==(const Quaternion& rhs) const noexcept
-	{
-		return ((this->w == rhs.w) && (this->x == rhs.x) && (this->y == rhs.y) && (this->z == rhs.z));
-	}
+template <typename... Ts>
+constexpr int TypeCount(TypeList<Ts...>) { return sizeof...(Ts); }
 
-	Quaternion operator-() const noexcept
-	{
-		return Quaternion{ -this->w, -this->x, -this->y, -this->z };
-	}
+// IDs start at 1, as they always have.
+template <typename T>
+struct ComponentTypeId
+{
+	static constexpr int value = TypeIndex<T, ComponentTypes>::value + 1;
 };
 
-struct BezierCurve
+template <typename... Ts>
+constexpr uint32_t ComponentSignature()
 {
-	std::vector<glm::vec3> points;
+	return (0u | ... | (1u << ComponentTypeId<Ts>::value));
+}
 
-	glm::vec3 GetPoint(float t)
-	{
-		std::vector<glm::vec3> ps = points;
-		std::vector<glm::vec3> tmp;
-
-		for (int i = 0; i < points.size(); i++)
-		{
-			for (int j = 0; j < ps.size() - 1; j++)
-			{
-				tmp.push_back(Util::Lerp(ps[j], ps[j + 1], t));
-			}
-
-			ps = tmp;
-			tmp.clear();
-
-			if (ps.size() == 1)
-			{
-				return ps[0];
-			}
-		}
-
-		return glm::vec3(0.0f, 0.0f, 0.0f);
-	}
-};
+static_assert(TypeCount(ComponentTypes()) < maxComponentTypes, "Entity::componentIDMap is too small for every component type.");
+
+constexpr int positionComponentID				= ComponentTypeId<PositionComponent>::value;
+constexpr int cubeComponentID					= ComponentTypeId<CubeComponent>::value;
+constexpr int animationComponentID				= ComponentTypeId<AnimationComponent>::value;
+constexpr int animationControllerComponentID	= ComponentTypeId<AnimationControllerComponent>::value;
+constexpr int inputComponentID					= ComponentTypeId<InputComponent>::value;
+constexpr int cameraFollowComponentID			= ComponentTypeId<CameraFollowComponent>::value;
+constexpr int billboardingComponentID			= ComponentTypeId<BillboardingComponent>::value;
+constexpr int actorComponentID					= ComponentTypeId<ActorComponent>::value;
+constexpr int movementComponentID				= ComponentTypeId<MovementComponent>::value;
+constexpr int modelComponentID					= ComponentTypeId<ModelComponent>::value;
 
-struct BezierQuaternion
+constexpr int playerAnimControllerSubID			= 1;
+
+class Component
 {
-	std::vector<Quaternion> rotations;
+public:
+	bool active;
+	Entity* entity;
+	int ID;
 
-	Quaternion GetQuaternion(float t)
-	{
-		std::vector<Quaternion> qs = rotations;
-		std::vector<Quaternion> tmp;
-
-		for (int i = 0; i < rotations.size(); i++)
-		{
-			for (int j = 0; j < qs.size() - 1; j++)
-			{
-				tmp.push_back(Util::Slerp(qs[j], qs[j + 1], t));
-			}
-
-			qs = tmp;
-			tmp.clear();
-
-			if (qs.size() == 1)
-			{
-				return qs[0];
-			}
-		}
-
-		return { 1.0f, 0.0f, 0.0f, 0.0f };
-	}
+	// Components are deleted through Component*, and that has to reach the right pool.
+	virtual ~Component() = default;
 };
 
-class PositionComponent : public Component
+class PositionComponent : public Component, public Pooled<PositionComponent>
 {
 public:
 	glm::vec3 position;
@@ -128,7 +106,7 @@ public:
 	PositionComponent(Entity* entity, bool active, glm::vec3 position, Quaternion quaternion);
 };
 
-class CubeComponent : public Component
+class CubeComponent : public Component, public Pooled<CubeComponent>
 {
 public:
 	int x;
@@ -140,12 +118,14 @@ public:
 
 	Texture* texture;
 
-	bool checked;
+	// One bit per Face that isn't pressed against a resting neighbour.
+	// Kept up to date by ECS::RefreshFaces whenever the grid around the cube changes.
+	uint8_t exposedFaces;
 
 	CubeComponent(Entity* entity, bool active, int x, int y, int z, glm::vec3 size, glm::vec4 color, Texture* texture);
 };
 
-class AnimationComponent : public Component
+class AnimationComponent : public Component, public Pooled<AnimationComponent>
 {
 public:
 	glm::vec3 baseOffset;
@@ -174,20 +154,23 @@ public:
 	AnimationComponent(Entity* entity, bool active, glm::vec3 baseOffset, Animation* idleAnimation, std::string animationName, float scaleX, float scaleY, bool flippedX, bool flippedY, glm::vec4 color);
 };
 
-class AnimationControllerComponent : public Component
+class AnimationControllerComponent : public Component, public Pooled<AnimationControllerComponent>
 {
 public:
 	AnimationComponent* animator;
 	int subID;
 };
 
-class PlayerAnimationControllerComponent : public AnimationControllerComponent
+class PlayerAnimationControllerComponent : public AnimationControllerComponent, public Pooled<PlayerAnimationControllerComponent>
 {
 public:
+	using Pooled<PlayerAnimationControllerComponent>::operator new;
+	using Pooled<PlayerAnimationControllerComponent>::operator delete;
+
 	PlayerAnimationControllerComponent(Entity* entity, bool active, AnimationComponent* animator);
 };
 
-class InputComponent : public Component
+class InputComponent : public Component, public Pooled<InputComponent>
 {
 public:
 	bool acceptInput;
@@ -201,7 +184,7 @@ public:
 	InputComponent(Entity* entity, bool active, bool acceptInput, float rollDelay, float turnDelay);
 };
 
-class CameraFollowComponent : public Component
+class CameraFollowComponent : public Component, public Pooled<CameraFollowComponent>
 {
 public:
 	Quaternion rotation;
@@ -218,23 +201,21 @@ public:
 	CameraFollowComponent(Entity* entity, bool active, Quaternion rotation, float distance, float speed, bool track, bool lockX, bool lockY, bool lockZ);
 };
 
-class BillboardingComponent : public Component
+class BillboardingComponent : public Component, public Pooled<BillboardingComponent>
 {
 public:
 	BillboardingComponent(Entity* entity, bool active);
 };
 
-enum class Face { front, back, left, right, top, bottom };
-enum class Corner { left, bottom, right, top };
-class ActorComponent : public Component
+class ActorComponent : public Component, public Pooled<ActorComponent>
 {
 public:
 	Face face;
-	Entity* cube; 
+	EntityHandle cube; 
 
 	float speed;
 
-	ActorComponent(Entity* entity, bool active, float speed, Face face, Entity* cube);
+	ActorComponent(Entity* entity, bool active, float speed, Face face, EntityHandle cube);
 }; 
 
 enum class MovementType { linear, bezier, rotation, bezierRotation };
@@ -255,33 +236,35 @@ struct Movement
 	{
 		return (this->ID == rhs->ID);
 	}
+
+	virtual ~Movement() = default;
 };
 
-struct LinearMovement : public Movement
+struct LinearMovement : public Movement, public Pooled<LinearMovement>
 {
 	glm::vec3 target;
 };
 
-struct BezierMovement : public Movement
+struct BezierMovement : public Movement, public Pooled<BezierMovement>
 {
 	BezierCurve curve;
 	float t = 0.0f;
 	float targetT = 1.0f;
 };
 
-struct RotatingMovement : public Movement
+struct RotatingMovement : public Movement, public Pooled<RotatingMovement>
 {
 	Quaternion targetRotation;
 };
 
-struct BezierRotatingMovement : public Movement
+struct BezierRotatingMovement : public Movement, public Pooled<BezierRotatingMovement>
 {
 	BezierQuaternion curve;
 	float t = 0.0f;
 	float targetT = 1.0f;
 };
 
-class MovementComponent : public Component
+class MovementComponent : public Component, public Pooled<MovementComponent>
 {
 public:
 	bool moving;
@@ -291,10 +274,12 @@ public:
 	void RegisterMovement(float speed, Quaternion target);
 	void RegisterMovement(float speed, BezierCurve curve, float targetT);
 	void RegisterMovement(float speed, BezierQuaternion curve, float targetT);
+	void SetMoving(bool moving);
 	MovementComponent(Entity* entity, bool active);
+	~MovementComponent();
 };
 
-class ModelComponent : public Component
+class ModelComponent : public Component, public Pooled<ModelComponent>
 {
 public:
 	Model* model;
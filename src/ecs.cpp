@@ -1,36 +1,40 @@
 #include "ecs.h"
 
 #include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <thread>
+#include <type_traits>
 #include <glm/gtx/norm.hpp>
 
 #include "game.h"
 #include "system.h"
 #include "entity.h"
 #include "puzzle.h"
+#include "threadpool.h"
 
 #pragma region Map
 
 glm::vec3 ECS::CubeToWorldSpace(int x, int y, int z)
 {
-	return glm::vec3((float)cubeSize * x, (float)cubeSize * y, (float)cubeSize * -z);
+	return PuzzleSim::CubeToWorldSpace(x, y, z);
 }
 
 glm::vec3 ECS::WorldToCubeSpace(glm::vec3 position)
 {
-	return glm::vec3((int)(position.x / cubeSize), (int)(position.y / cubeSize), (int)(-position.z / cubeSize));
+	return PuzzleSim::WorldToCubeSpace(position);
 }
 
 void ECS::PositionCube(CubeComponent* cube, int x, int y, int z)
 {
-	PositionComponent* pos = (PositionComponent*)cube->entity->componentIDMap[positionComponentID];
+	PositionComponent* pos = cube->entity->Get<PositionComponent>();
 	pos->position = CubeToWorldSpace(x, y, z);
 }
 
 void ECS::PositionActor(ActorComponent* actor)
 {
-	PositionComponent* pos = (PositionComponent*)actor->entity->componentIDMap[positionComponentID];
-	CubeComponent* cube = (CubeComponent*)actor->cube->componentIDMap[cubeComponentID];
+	PositionComponent* pos = actor->entity->Get<PositionComponent>();
+	CubeComponent* cube = GetEntity(actor->cube)->Get<CubeComponent>();
 	
 	Quaternion r = Util::GetQuaternionFromFace(actor->face);
 	pos->position = CubeToWorldSpace(cube->x, cube->y, cube->z) + Util::Rotate(glm::vec3(0.0f, (float)cubeSize, 0.0f), r);
@@ -47,1003 +51,827 @@ void ECS::MoveCube(CubeComponent* cube, int x, int y, int z)
 	cube->y = y;
 	cube->z = z;
 
-	cubes[x][y][z] = cube->entity;
+	MovementComponent* mover = cube->entity->Get<MovementComponent>();
+	if (mover != nullptr) sim.grid.SetMoving(x, y, z, mover->moving);
+
+	RefreshFaces(x, y, z);
 }
 
-Entity* ECS::GetCube(int x, int y, int z)
+void ECS::RefreshFaces(int x, int y, int z)
 {
-	if (x >= 0 && x < maxWidth &&
-		y >= 0 && y < maxHeight &&
-		z >= 0 && z < maxDepth)
-	{
-		return ECS::main.cubes[x][y][z];
-	}
-	else
+	// Only the cell itself and the cells that share a face with it can have gained or lost a neighbour.
+	EntityHandle neighbourhood[1 + VoxelGrid::faceCount];
+	sim.grid.GetNeighbourhood(x, y, z, neighbourhood);
+
+	for (int i = 0; i < 1 + VoxelGrid::faceCount; i++)
 	{
-		return nullptr;
+		Entity* e = GetEntity(neighbourhood[i]);
+		if (e == nullptr) continue;
+
+		CubeComponent* cube = e->Get<CubeComponent>();
+		if (cube != nullptr) cube->exposedFaces = sim.grid.ExposedFaces(cube->x, cube->y, cube->z);
 	}
 }
 
-void ECS::MoveActor(ActorComponent* actor, int dX, int dY, int dZ)
+void ECS::RefreshAllFaces()
 {
-	CubeComponent* currentCube = (CubeComponent*)actor->cube->componentIDMap[cubeComponentID];
-	Entity* target = GetCube(currentCube->x + dX, currentCube->y + dY, currentCube->z + dZ);
-	if (target != nullptr)
+	// For building a level in bulk: a chunk's worth of masks at a time, sixteen cells to a word.
+	std::vector<VoxelGrid::Chunk*> chunks;
+	sim.grid.CollectChunks(chunks);
+
+	ThreadPool::main.ParallelFor((int)chunks.size(), 1, [&](int chunk, int, int)
 	{
-		glm::vec3 relativeUp = Util::GetRelativeUp(actor->face);
+		VoxelGrid::Chunk& c = *chunks[chunk];
 
-		Entity* targetUp = GetCube(currentCube->x + dX + (int)relativeUp.x, currentCube->y + dY + (int)relativeUp.y, currentCube->z + dZ + (int)relativeUp.z);
+		uint16_t faces[VoxelGrid::faceCount][VoxelGrid::chunkRows];
+		sim.grid.ComputeFaceRows(c, faces);
 
-		if (targetUp == nullptr && target != nullptr)
+		for (int r = 0; r < VoxelGrid::chunkRows; r++)
 		{
-			CubeComponent* targetCube = (CubeComponent*)target->componentIDMap[cubeComponentID];
-			PositionComponent* targetPos = (PositionComponent*)target->componentIDMap[positionComponentID];
+			if (c.occupied[r] == 0) continue;
+
+			for (int lx = 0; lx < VoxelGrid::chunkSize; lx++)
+			{
+				if (((c.occupied[r] >> lx) & 1) == 0) continue;
 
-			actor->cube = target;
+				Entity* e = GetEntity(c.cells[VoxelGrid::CellIndex(lx, r & VoxelGrid::chunkMask, r >> 4)]);
+				if (e == nullptr) continue;
 
-			Quaternion r = Util::GetQuaternionFromFace(actor->face);
-			glm::vec3 t = targetPos->position + Util::Rotate(glm::vec3(0.0f, (float)cubeSize, 0.0f), r);
+				CubeComponent* cube = e->Get<CubeComponent>();
+				if (cube == nullptr) continue;
+
+				uint8_t mask = 0;
+				for (int f = 0; f < VoxelGrid::faceCount; f++)
+				{
+					mask |= (uint8_t)(((faces[f][r] >> lx) & 1) << f);
+				}
 
-			MovementComponent* mover = (MovementComponent*)actor->entity->componentIDMap[movementComponentID];
-			mover->RegisterMovement(actor->speed, t);
+				cube->exposedFaces = mask;
+			}
 		}
-	}
+	});
 }
 
-std::pair<Face, bool> ECS::FindFulcrum(CubeComponent* activeCube, Face activeFace, Face rollDirection)
+Entity* ECS::GetCube(int x, int y, int z)
 {
-	// This serves to find the cube off which any rotating cube should intuitively push.
-	// This will usually be right below the cube, but this should also account for when
-	// the player is pushing a cube perpendicular to the surface it should land on
-	// rather than parallel to it.
-
-	// First we'll check right below the active cube (relative to the direction being pushed).
-	
-	glm::vec3 expectedDirection = -Util::GetRelativeUp(activeFace);
-	Entity* possibleFulcrum = GetCube(	activeCube->x + expectedDirection.x,
-										activeCube->y + expectedDirection.y,
-										activeCube->z + expectedDirection.z);
-
-	if (possibleFulcrum != nullptr)
-	{
-		return std::pair<Face, bool>(Util::GetFaceFromDifference(expectedDirection), true);
-	}
-
-	// In this case, the fulcrum is not where we expected it to be.
-	// Now, we should check to see if the fulcrum is instead opposite the rolling direction.
-	// This will warrant the same reaction as the above fulcrum.
+	return GetEntity(sim.grid.Get(x, y, z));
+}
 
-	expectedDirection = -Util::GetRelativeUp(rollDirection);
-	possibleFulcrum = GetCube(	activeCube->x + expectedDirection.x,
-								activeCube->y + expectedDirection.y,
-								activeCube->z + expectedDirection.z);
+SimActor ECS::GetSimActor(ActorComponent* actor)
+{
+	CubeComponent* cube = GetEntity(actor->cube)->Get<CubeComponent>();
+	return { actor->entity->GetHandle(), actor->cube, glm::ivec3(cube->x, cube->y, cube->z), actor->face };
+}
 
-	if (possibleFulcrum != nullptr)
-	{
-		return std::pair<Face, bool>(Util::GetFaceFromDifference(expectedDirection), true);
-	}
+uint64_t ECS::StateHash(ActorComponent* actor)
+{
+	return sim.StateHash(GetSimActor(actor));
+}
 
-	// In this case, neither of the allowed fulcrum points can be found.
-	return std::pair<Face, bool>(Util::GetFaceFromDifference(expectedDirection), false);
+void ECS::MoveActor(ActorComponent* actor, int dX, int dY, int dZ)
+{
+	SimActor simActor = GetSimActor(actor);
+	sim.Walk(simActor, dX, dY, dZ);
 }
 
-Face ECS::DetermineRollDirection(Face fulcrum, Face activeFace, Face rollDirection)
+void ECS::RollCube(ActorComponent* actor, Face rollDirection)
 {
-	glm::vec3 fulcrumUp = Util::GetRelativeUp(fulcrum);
-	glm::vec3 activeDown = -Util::GetRelativeUp(activeFace);
+	SimActor simActor = GetSimActor(actor);
+	sim.Roll(simActor, rollDirection);
+}
 
-	// If the fulcrum is right below the face the actor is standing on.
-	if (fulcrumUp == activeDown)
-	{
-		// Then we want to roll in the direction specified by rollDirection.
-		return rollDirection;
-	}
+// Subscribed to the sim in Init. By the time this runs the move has already happened in the grid;
+// all that's left is to bring the components up to date and animate them getting there.
+void ECS::OnMove(const MoveEvent& move)
+{
+	ActorComponent* actor = GetEntity(move.after.entity)->Get<ActorComponent>();
+	actor->cube = move.after.cube;
 
-	// If the fulcrum is below the roll direction, then we want to move opposite the activeFace.
-	if (fulcrumUp == -Util::GetRelativeUp(rollDirection))
+	if (move.type == MoveType::walk)
 	{
-		return Util::GetFaceFromDifference(activeDown);
-	}
+		PositionComponent* targetPos = GetEntity(move.after.cube)->Get<PositionComponent>();
 
-	// These are technically, I believe, the only inputs we expect to receive, but just in case:
-	return rollDirection;
-}
+		Quaternion r = Util::GetQuaternionFromFace(actor->face);
+		glm::vec3 t = targetPos->position + Util::Rotate(glm::vec3(0.0f, (float)cubeSize, 0.0f), r);
 
-//bool ECS::CheckAutofrendation(CubeComponent* activeCube, Face activeFace, Face rollDirection)
-//{
-//	// True = Autofrendated.
-//	// False = Not autofrendated.
-//
-//	// I'm not actually sure we need this function....
-//}
+		MovementComponent* mover = actor->entity->Get<MovementComponent>();
+		mover->RegisterMovement(actor->speed, t);
+		return;
+	}
 
-void ECS::FloodFill(std::vector<CubeComponent*> &inside, CubeComponent* cube, CubeComponent* activeCube, CubeComponent* fulcrum)
-{
-	auto result = std::find(inside.rbegin(), inside.rend(), cube);
-	int location;
+	bool half = move.type == MoveType::halfRoll;
+	int turns = std::max(2, (int)(2 * (move.t)));
 
-	if (result != inside.rend())
+	for (int i = 0; i < move.cubes.size(); i++)
 	{
-		location = inside.rend() - result;
-	}
-	else
-	{
-		location = -1;
+		MoveCube(GetEntity(move.cubes[i].cube)->Get<CubeComponent>(), move.cubes[i].to.x, move.cubes[i].to.y, move.cubes[i].to.z);
 	}
 
-	if (location != -1)
+	for (int i = 0; i < move.cubes.size(); i++)
 	{
-		return;
+		RefreshFaces(move.cubes[i].from.x, move.cubes[i].from.y, move.cubes[i].from.z);
 	}
-	else
+
+	glm::vec3 forward = Util::GetRelativeUp(move.roll);
+	if (forward.z != 0) forward *= -1.0f;
+	glm::vec3 up = Util::GetRelativeUp(move.axis);
+	if (up.z != 0) up *= -1.0f;
+
+	for (int i = 0; i < move.cubes.size(); i++)
 	{
-		float distToCube = glm::length2(glm::vec3(activeCube->x, activeCube->y, activeCube->z) - glm::vec3(cube->x, cube->y, cube->z));
-		float distToFulcrum = glm::length2(glm::vec3(fulcrum->x, fulcrum->y, fulcrum->z) - glm::vec3(cube->x, cube->y, cube->z));
+		Entity* e = GetEntity(move.cubes[i].cube);
+		PositionComponent* pc = e->Get<PositionComponent>();
+		MovementComponent* mc = e->Get<MovementComponent>();
 
-		if (distToCube < distToFulcrum)
+		glm::vec3 finalPoint = CubeToWorldSpace(move.cubes[i].to.x, move.cubes[i].to.y, move.cubes[i].to.z);
+
+		if (!half && move.cubes.size() == 1)
 		{
-			inside.push_back(cube);
+			// A lone cube hops over in an arc.
+			glm::vec3 landingUp = Util::GetRelativeUp(move.axis);
+			glm::vec3 leap = (glm::normalize(landingUp) * 5.0f);
+			if (landingUp.z != 0) leap *= -1.0f;
+			glm::vec3 zenith = ((pc->position + finalPoint) / 2.0f) + leap;
 
-			for (int x = -1; x <= 1; x++)
-			{
-				for (int y = -1; y <= 1; y++)
-				{
-					for (int z = -1; z <= 1; z++)
-					{
-						if ((x != 0 || y != 0 || z != 0) &&		// Ensures that you're not looking at the center cube.
-							(abs(x) + abs(y) + abs(z) == 1))	// I believe this is a more elegant way to solve this than my previous method.
-						{
-							Entity* activeCubeEntity = GetCube(cube->x + x, cube->y + y, cube->z + z);
+			mc->RegisterMovement(3.5f, { { pc->position, zenith, finalPoint } }, 1.0f);
+		}
+		else
+		{
+			// Anything else swings round the same curve the sim swept it along.
+			float dist = glm::length(pc->position - finalPoint);
+			float length = dist * cos(45) * (2.0 / 3.0f);
+			glm::vec3 p1 = pc->position + (forward * length);
+			glm::vec3 p2 = finalPoint + (up * length);
 
-							if (activeCubeEntity != nullptr)
-							{
-								CubeComponent* nextCube = (CubeComponent*)activeCubeEntity->componentIDMap[cubeComponentID];
-								FloodFill(inside, nextCube, activeCube, fulcrum);
-							}
-						}
-					}
-				}
-			}
+			mc->RegisterMovement(3.5f, { { pc->position, p1, p2, finalPoint } }, 1.0f);
+		}
+
+		Quaternion r = Util::GetRollRotation(move.axis, move.roll, pc->quaternion, turns);
+
+		if (half)
+		{
+			Quaternion r2 = Util::GetRollRotation(move.axis, move.roll, r, turns);
+			mc->RegisterMovement(3.5f, { { pc->quaternion, r, r2 } }, 1.0f);
+		}
+		else
+		{
+			mc->RegisterMovement(3.5f, { { pc->quaternion, r } }, 1.0f);
 		}
 	}
+
+	// Oh, and we roll the actor onto the right face.
+	RollActor(actor, move.roll, move.axis, move.after.face, half);
 }
 
-std::vector<CubeComponent*> ECS::DetermineStructure(CubeComponent* cube, CubeComponent* fulcrum, Face direction)
+void ECS::RollActor(ActorComponent* actor, Face rollDirection, Face landingFace, Face standingFace, bool half)
 {
-	std::vector<CubeComponent*> retCubes;
-	retCubes.push_back(cube);
+	PositionComponent* pos = actor->entity->Get<PositionComponent>();
+	MovementComponent* mover = actor->entity->Get<MovementComponent>();
+	CubeComponent* cube = GetEntity(actor->cube)->Get<CubeComponent>();
 
-	glm::vec3 startDirection = Util::GetRelativeUp(direction);
+	Quaternion r = Util::GetRollRotation(landingFace, rollDirection, pos->quaternion, 2);
+	glm::vec3 endPos = CubeToWorldSpace(cube->x, cube->y, cube->z) + Util::Rotate(glm::vec3(0.0f, (float)cubeSize, 0.0f), Util::GetQuaternionFromFace(standingFace));
+
+	glm::vec3 forward = Util::GetRelativeUp(rollDirection);
+	if (forward.z != 0) forward *= -1.0f;
+	glm::vec3 up = Util::GetRelativeUp(landingFace);
+	if (up.z != 0) up *= -1.0f;
+	float dist = glm::length(pos->position - endPos);
+	float length = dist * cos(45) * (2.0 / 3.0f);
+	glm::vec3 p1 = pos->position + (forward * length);
+	glm::vec3 p2 = endPos + (up * length);
 
-	Entity* activeCubeEntity = GetCube(cube->x + (int)startDirection.x, cube->y + (int)startDirection.y, cube->z + (int)startDirection.z);
+	mover->RegisterMovement(3.5f, { { pos->position, p1, p2, endPos } }, 1.0f);
 
-	if (activeCubeEntity == nullptr)
+	if (half)
+	{
+		Quaternion r2 = Util::GetRollRotation(landingFace, rollDirection, r, 2);
+		mover->RegisterMovement(3.5f, { {pos->quaternion, r, r2 } }, 1.0f);
+	}
+	else
 	{
-		return retCubes;
+		mover->RegisterMovement(3.5f, { { pos->quaternion, r } }, 1.0f);
 	}
 
-	CubeComponent* activeCube = (CubeComponent*)activeCubeEntity->componentIDMap[cubeComponentID];
+	actor->face = standingFace;
+}
 
-	FloodFill(retCubes, activeCube, cube, fulcrum);
+#pragma endregion
 
-	if (retCubes.size() < 4)
-	{
-		return retCubes;
-	}
+#pragma region Entities
 
-	int touchingSidesFulcrum = 0;
-	bool tf = false,
-		tb = false,
-		tr = false,
-		tl = false,
-		tu = false,
-		td = false;
+uint32_t NameTable::Intern(const std::string& name)
+{
+	auto result = ids.find(name);
+	if (result != ids.end()) return result->second;
 
-	for (int i = 0; i < retCubes.size(); i++)
-	{
-		CubeComponent* c = retCubes[i];
-		if (c != cube)
-		{
-			int diffX = c->x - cube->x;
-			int diffY = c->y - cube->y;
-			int diffZ = c->z - cube->z;
+	uint32_t id = (uint32_t)names.size();
+	names.push_back(name);
+	ids.emplace(name, id);
 
-			if (diffX == 1 && diffY == 0 && diffZ == 0) tr = true;
-			else if (diffX == -1 && diffY == 0 && diffZ == 0) tl = true;
-			else if (diffX == 0 && diffY == 1 && diffZ == 0) tu = true;
-			else if (diffX == 0 && diffY == -1 && diffZ == 0) td = true;
-			else if (diffX == 0 && diffY == 0 && diffZ == 1) tb = true;
-			else if (diffX == 0 && diffY == 0 && diffZ == -1) tf = true;
+	return id;
+}
 
-			int diff = abs(fulcrum->x - c->x) + abs(fulcrum->y - c->y) + abs(fulcrum->z - c->z);
+const std::string& NameTable::Get(uint32_t id)
+{
+	return names[id];
+}
 
-			if (diff == 1)
-			{
-				touchingSidesFulcrum++;
-			}
-		}
-	}
+int Entity::GetID() { return (int)handle.value; }
+EntityHandle Entity::GetHandle() { return handle; }
+int Entity::GetScene() { return scene; }
 
-	if (tf && direction == Face::back ||
-		tb && direction == Face::front ||
-		tr && direction == Face::left ||
-		tl && direction == Face::right ||
-		tu && direction == Face::bottom ||
-		td && direction == Face::top)
-	{
-		retCubes.clear();
-		return retCubes;
-	}
+#if ENTITY_NAMES
+const std::string& Entity::GetName() { return NameTable::main.Get(nameID); }
+void Entity::SetName(const std::string& name) { this->nameID = NameTable::main.Intern(name); }
+#else
+const std::string& Entity::GetName() { static const std::string unnamed; return unnamed; }
+void Entity::SetName(const std::string& name) {}
+#endif
 
-	if (touchingSidesFulcrum > 2)
-	{
-		retCubes.clear();
-		return retCubes;
-	}
-	else
+void Entity::SetHandle(EntityHandle handle) { this->handle = handle; }
+void Entity::SetScene(int scene) { this->scene = scene; }
+
+Entity::Entity(EntityHandle handle, int scene, const std::string& name)
+{
+	this->handle = handle;
+	this->scene = scene;
+	SetName(name);
+
+	this->signature = 0;
+	for (int i = 0; i < maxComponentTypes; i++)
 	{
-		return retCubes;
+		componentIDMap[i] = nullptr;
 	}
+};
+
+#pragma endregion
+
+#pragma region ECS
+
+uint32_t ECS::GetOtherID()
+{
+	return ++otherIDCounter;
+}
+
+void ECS::Init()
+{
+	// The main thread runs systems too, so it doesn't need a worker of its own.
+	ThreadPool::main.Start((int)std::thread::hardware_concurrency() - 1);
+
+	sim.Subscribe([this](const MoveEvent& move) { OnMove(move); });
+
+	BuildSchedule();
 }
 
-void ECS::QuarterRoll(ActorComponent* actor, Face standingFace, Face rollDirection, Entity* landingTarget, Face landingFace, std::vector<CubeComponent*> affectedCubes)
+void ECS::BuildSchedule()
 {
-	// We need to grab some components first.
-	CubeComponent* activeCube = (CubeComponent*)actor->cube->componentIDMap[cubeComponentID];
-	PositionComponent* pos = (PositionComponent*)actor->cube->componentIDMap[positionComponentID];
-	MovementComponent* mover = (MovementComponent*)actor->cube->componentIDMap[movementComponentID];
-	CubeComponent* landingCube = (CubeComponent*)landingTarget->componentIDMap[cubeComponentID];
+	schedule.clear();
 
-	// And just as a precaution.
-	Face activeFace = actor->face;
-	Face roll = rollDirection;
+	ForEachSystem([&](auto& system)
+	{
+		using S = std::decay_t<decltype(system)>;
 
-	// This is a secret tool that will help us later.
-	glm::vec3 pivotPos = glm::vec3(activeCube->x, activeCube->y, activeCube->z);
+		ScheduledSystem s;
+		s.update = [&system](int scene, float deltaTime) { system.Update(scene, deltaTime); };
+		s.reads = S::reads;
+		s.writes = S::writes;
+		s.mainThread = S::mainThread;
 
-	// And then we can figure out where it is going to land in cube and world space.
-	glm::vec3 landingUp = Util::GetRelativeUp(landingFace);
-	glm::vec3 landingCubePosition = glm::vec3(landingCube->x + (int)landingUp.x, landingCube->y + (int)landingUp.y, landingCube->z + (int)landingUp.z);
-	glm::vec3 landingWorldPosition = CubeToWorldSpace(landingCubePosition.x, landingCubePosition.y, landingCubePosition.z);
+		schedule.push_back(s);
+	});
 
-	// This is going to be the smallest t value at which a collision occurs.
-	float minT = 1.0f;
+	// Two systems conflict if either writes something the other touches.
+	// A conflicting pair keeps the order it has in the systems tuple, so the frame
+	// comes out the same as if everything had run one after another.
+	int n = (int)schedule.size();
 
-	// First, we need to sweep the whole cube structure over its whole course to see if it collides with anything.
-	// There might be a more elegant way to do this, but we're just gonna go ahead and do it the slow(er) way.
-	for (int i = 0; i < affectedCubes.size(); i++)
+	for (int j = 0; j < n; j++)
 	{
-		// We need to grab the cube and position components, as well as their movement components.
-		CubeComponent* c = affectedCubes[i];
-		PositionComponent* pc = (PositionComponent*)c->entity->componentIDMap[positionComponentID];
-		MovementComponent* mc = (MovementComponent*)c->entity->componentIDMap[movementComponentID];
-
-		int dX = pivotPos.x - c->x;
-		int dY = pivotPos.y - c->y;
-		int dZ = pivotPos.z - c->z;
-
-		Quaternion diffRot = Util::GetRollRotation(landingFace, roll, { 1, 0, 0, 0 }, 1);
-		glm::vec3 newDifference = Util::Rotate(glm::vec3(-dX, dY, dZ), diffRot);
-
-		// And then we need to convert that to world space, instead of cube space.
-		glm::vec3 worldDifference = CubeToWorldSpace(landingCubePosition.x + (int)newDifference.x, landingCubePosition.y + (int)newDifference.y, landingCubePosition.z + (int)newDifference.z);
-
-		glm::vec3 forward = Util::GetRelativeUp(roll);
-		if (forward.z != 0) forward *= -1.0f;
-		glm::vec3 up = Util::GetRelativeUp(landingFace);
-		if (up.z != 0) up *= -1.0f;
-		float dist = glm::length(pc->position - worldDifference);
-		float length = dist * cos(45) * (2.0 / 3.0f);
-		glm::vec3 p1 = pc->position + (forward * length);
-		glm::vec3 p2 = worldDifference + (up * length);
-
-		BezierCurve b = { { pc->position, p1, p2, worldDifference } };
-
-		float lastSafeT = 0.0f;
-		for (float j = 0.0f; j < 1.0f; j += 0.01f)
+		for (int i = 0; i < j; i++)
 		{
-			glm::vec3 cubeSpace = WorldToCubeSpace(b.GetPoint(j));
-			Entity* e = GetCube(cubeSpace.x, cubeSpace.y, cubeSpace.z);
-			if (e != nullptr && e != c->entity)
-			{
-				bool isAffected = false;
-
-				for (int m = 0; m < affectedCubes.size(); m++)
-				{
-					if (e == affectedCubes[m]->entity)
-					{
-						isAffected = true;
-					}
-				}
-				
-				if (!isAffected)
-				{
-					minT = std::min(lastSafeT, minT);
-					break;
-				}
+			const ScheduledSystem& a = schedule[i];
+			const ScheduledSystem& b = schedule[j];
 
-				lastSafeT = j;
-			}
-			else
+			if ((a.writes & (b.reads | b.writes)) != 0 ||
+				(b.writes & a.reads) != 0)
 			{
-				lastSafeT = j;
+				schedule[i].dependents.push_back(j);
+				schedule[j].dependencies++;
 			}
 		}
 	}
 
-	if (minT == 0.0f) return;
+	waitingOn = std::make_unique<std::atomic<int>[]>(n);
+}
 
-	// Now, we need to quickly unassign all the affected cubes from their old positions.
-	// So that we don't run into any bugs when we add them to a new spot.
+void ECS::RunSystems(float deltaTime)
+{
+	int n = (int)schedule.size();
+	systemsLeft = n;
 
-	for (int i = 0; i < affectedCubes.size(); i++)
+	for (int i = 0; i < n; i++)
 	{
-		CubeComponent* cube = affectedCubes[i];
-		cubes[cube->x][cube->y][cube->z] = nullptr;
+		waitingOn[i] = schedule[i].dependencies;
 	}
 
-	// Now we need to figure out how the cube is gonna roll.
-	Quaternion newRotation = Util::GetRollRotation(landingFace, roll, pos->quaternion, std::max(2, (int)(2 * (minT))));
-	glm::vec3 activeFinalPoint = landingWorldPosition;
-	glm::vec3 activeCubeSpace = landingCubePosition;
-
-	// Then, we register the movements to the landing position with the active cube's movement component.
-	// The bezier curve is a little complicated.
-	if (affectedCubes.size() > 1)
+	for (int i = 0; i < n; i++)
 	{
-		glm::vec3 forward = Util::GetRelativeUp(roll);
-		if (forward.z != 0) forward *= -1.0f;
-		glm::vec3 up = Util::GetRelativeUp(landingFace);
-		if (up.z != 0) up *= -1.0f;
-		float dist = glm::length(pos->position - landingWorldPosition);
-		float length = dist * cos(45) * (2.0 / 3.0f);
-		glm::vec3 p1 = pos->position + (forward * length);
-		glm::vec3 p2 = landingWorldPosition + (up * length);
-
-		BezierCurve b = { { pos->position, p1, p2, landingWorldPosition } };
-		activeCubeSpace = WorldToCubeSpace(b.GetPoint(minT));
-		activeFinalPoint = CubeToWorldSpace(activeCubeSpace.x, activeCubeSpace.y, activeCubeSpace.z);
-		dist = glm::length(pos->position - activeFinalPoint);
-		length = dist * cos(45) * (2.0 / 3.0f);
-		p1 = pos->position + (forward * length);
-		p2 = activeFinalPoint + (up * length);
-
-		mover->RegisterMovement(3.5f, { { pos->position, p1, p2, activeFinalPoint } }, 1.0f);
+		if (schedule[i].dependencies == 0) DispatchSystem(i, deltaTime);
 	}
-	else
-	{
-		glm::vec3 leap = (glm::normalize(landingUp) * 5.0f);
-		if (landingUp.z != 0) leap *= -1.0f;
-		glm::vec3 zenith = ((pos->position + landingWorldPosition) / 2.0f) + leap;
-
-		mover->RegisterMovement(3.5f, { { pos->position, zenith, landingWorldPosition } }, 1.0f);
-	}
-
-	mover->RegisterMovement(3.5f, {{ pos->quaternion, newRotation }}, 1.0f);
-
-	// And finally position the active cube in the right position.
-	MoveCube(activeCube, activeCubeSpace.x, activeCubeSpace.y, activeCubeSpace.z);
 
-	// Oh, and we roll the actor onto the right face.
-	RollActor(actor, roll, landingFace, standingFace, false);
-
-	// But we can't forget that this might involve a larger structure of cubes.
-	// This is where things get a little complicated.
-	for (int j = 1; j < affectedCubes.size(); j++)
+	// Rather than block, the main thread runs whatever is ready: its own systems first, then the pool's.
+	while (systemsLeft > 0)
 	{
-		// We need to grab the cube and position components, as well as their movement components.
-		CubeComponent* c = affectedCubes[j];
-		PositionComponent* pc = (PositionComponent*)c->entity->componentIDMap[positionComponentID];
-		MovementComponent* mc = (MovementComponent*)c->entity->componentIDMap[movementComponentID];
-
-		// There are two rotations necessary here.
-		// The first is the rotation of the actual position component.
-		Quaternion affRot = Util::GetRollRotation(landingFace, roll, pc->quaternion, std::max(2, (int)(2 * (minT))));
-
-		// And the second is the rotation in space around the initial cube.
-		Quaternion diffRot = Util::GetRollRotation(landingFace, roll, { 1, 0, 0, 0 }, 1);
-
-		// We need to record the initial difference in position between this cube
-		// and the cube we rolled earlier.
-		// We could've waited to finalize the movement of the "active" cube,
-		// but we'll instead make use of that handy pivot point we saved earlier.
-		int dX = pivotPos.x - c->x;
-		int dY = pivotPos.y - c->y;
-		int dZ = pivotPos.z - c->z;
-
-		// if (dY != 0 && dZ != 0) dX *= -1.0f;
-
-		// Now, we need to figure out what the difference should be after the rotation of the structure.
-		glm::vec3 newDifference = Util::Rotate(glm::vec3(-dX, dY, dZ), diffRot);
-
-		// And then we need to convert that to world space, instead of cube space.
-		glm::vec3 worldDifference = CubeToWorldSpace(landingCubePosition.x + (int)newDifference.x, landingCubePosition.y + (int)newDifference.y, landingCubePosition.z + (int)newDifference.z);
-
-		// Finally, we can register the necessary movements with the movement component and actually finalize the movement of the cube in cube space.
-		glm::vec3 forward = Util::GetRelativeUp(roll);
-		if (forward.z != 0) forward *= -1.0f;
-		glm::vec3 up = Util::GetRelativeUp(landingFace);
-		if (up.z != 0) up *= -1.0f;
-		float dist = glm::length(pc->position - worldDifference);
-		float length = dist * cos(45) * (2.0 / 3.0f);
-		glm::vec3 p1 = pc->position + (forward * length);
-		glm::vec3 p2 = worldDifference + (up * length);
-
-		BezierCurve b = { { pc->position, p1, p2, worldDifference } };
-		glm::vec3 cubeSpace = WorldToCubeSpace(b.GetPoint(minT));
-		glm::vec3 finalPoint = CubeToWorldSpace(cubeSpace.x, cubeSpace.y, cubeSpace.z);
-		dist = glm::length(pc->position - finalPoint);
-		length = dist * cos(45) * (2.0 / 3.0f);
-		p1 = pc->position + (forward * length);
-		p2 = finalPoint + (up * length);
-
-		/*CubeComponent* lastCube = affectedCubes[j - 1];
-		if (abs(cubeSpace.x - lastCube->x) + abs(cubeSpace.y - lastCube->y) + abs(cubeSpace.z - lastCube->z) > 1)
+		int next = -1;
+
 		{
-			cubeSpace = (cubeSpace + glm::vec3(lastCube->x, lastCube->y, lastCube->z)) / 2.0f;
-		}*/
-		finalPoint = CubeToWorldSpace(cubeSpace.x, cubeSpace.y, cubeSpace.z);
+			std::lock_guard<std::mutex> lock(mainThreadMutex);
 
-		mc->RegisterMovement(3.5f, { { pc->position, p1, p2, finalPoint } }, 1.0f);
-		mc->RegisterMovement(3.5f, { { pc->quaternion, affRot } }, 1.0f);
+			if (mainThreadReady.size() > 0)
+			{
+				next = mainThreadReady.back();
+				mainThreadReady.pop_back();
+			}
+		}
 
-		MoveCube(c, cubeSpace.x, cubeSpace.y, cubeSpace.z);
+		if (next != -1)
+		{
+			RunSystem(next, deltaTime);
+		}
+		else if (!ThreadPool::main.RunOne())
+		{
+			std::this_thread::yield();
+		}
 	}
 }
 
-void ECS::HalfRoll(ActorComponent* actor, Face standingFace, Face oppFulcrum, Face rollDirection, Entity* landingTarget, Face landingFace, std::vector<CubeComponent*> affectedCubes)
+// Folds every drawing system's buffers into the renderer in system order, then chunk order,
+// which is exactly the order the old single-threaded loops prepared them in.
+void ECS::SubmitRenderBuffers()
 {
-	// We need to grab some components first.
-	CubeComponent* activeCube = (CubeComponent*)actor->cube->componentIDMap[cubeComponentID];
-	PositionComponent* pos = (PositionComponent*)actor->cube->componentIDMap[positionComponentID];
-	MovementComponent* mover = (MovementComponent*)actor->cube->componentIDMap[movementComponentID];
-	CubeComponent* landingCube = (CubeComponent*)landingTarget->componentIDMap[cubeComponentID];
-
-	// And just as a precaution.
-	Face activeFace = actor->face;
-	Face roll = rollDirection;
-
-	// This is a secret tool that will help us later.
-	glm::vec3 pivotPos = glm::vec3(activeCube->x, activeCube->y, activeCube->z);
-
-	// And then we can figure out where it is going to land in cube and world space.
-	glm::vec3 landingUp = Util::GetRelativeUp(landingFace);
-	glm::vec3 landingCubePosition = glm::vec3(landingCube->x + landingUp.x, landingCube->y + landingUp.y, landingCube->z + landingUp.z);
-	glm::vec3 landingWorldPosition = CubeToWorldSpace(landingCubePosition.x, landingCubePosition.y, landingCubePosition.z);
-
-	// This is going to be the smallest t value at which a collision occurs.
-	float minT = 1.0f;
-
-	// First, we need to sweep the whole cube structure over its whole course to see if it collides with anything.
-	// There might be a more elegant way to do this, but we're just gonna go ahead and do it the slow(er) way.
-	for (int i = 0; i < affectedCubes.size(); i++)
+	ForEachSystem([&](auto& system)
 	{
-		// We need to grab the cube and position components, as well as their movement components.
-		CubeComponent* c = affectedCubes[i];
-		PositionComponent* pc = (PositionComponent*)c->entity->componentIDMap[positionComponentID];
-		MovementComponent* mc = (MovementComponent*)c->entity->componentIDMap[movementComponentID];
-
-		int dX = pivotPos.x - c->x;
-		int dY = pivotPos.y - c->y;
-		int dZ = pivotPos.z - c->z;
-
-		Quaternion diffRot = Util::GetRollRotation(oppFulcrum, roll, { 1, 0, 0, 0 }, 1);
-		glm::vec3 newDifference = Util::Rotate(glm::vec3(dX, dY, dZ), diffRot);
-
-		// And then we need to convert that to world space, instead of cube space.
-		glm::vec3 worldDifference = CubeToWorldSpace(landingCubePosition.x + (int)newDifference.x, landingCubePosition.y + (int)newDifference.y, landingCubePosition.z + (int)newDifference.z);
-
-		glm::vec3 forward = Util::GetRelativeUp(roll);
-		if (forward.z != 0) forward *= -1.0f;
-		glm::vec3 up = Util::GetRelativeUp(landingFace);
-		if (up.z != 0) up *= -1.0f;
-		float dist = glm::length(pc->position - worldDifference);
-		float length = dist * cos(45) * (2.0 / 3.0f);
-		glm::vec3 p1 = pc->position + (forward * length);
-		glm::vec3 p2 = worldDifference + (up * length);
-
-		BezierCurve b = { { pc->position, p1, p2, worldDifference } };
-
-		float lastSafeT = 0.0f;
-		for (float j = 0.0f; j < 1.0f; j += 0.01f)
-		{
-			glm::vec3 cubeSpace = WorldToCubeSpace(b.GetPoint(j));
-			Entity* e = GetCube(cubeSpace.x, cubeSpace.y, cubeSpace.z);
+		using S = std::decay_t<decltype(system)>;
 
-			if (e != nullptr && e != c->entity)
+		if constexpr (RendersGeometry<S>::value)
+		{
+			for (int i = 0; i < system.renderBuffers.size(); i++)
 			{
-				bool isAffected = false;
+				Game::main.renderer->Submit(system.renderBuffers[i]);
+				system.renderBuffers[i].Clear();
+			}
+		}
 
-				for (int m = 0; m < affectedCubes.size(); m++)
-				{
-					if (e == affectedCubes[m]->entity || e == landingTarget)
-					{
-						isAffected = true;
-					}
-				}
+		if constexpr (RendersStaticMeshes<S>::value)
+		{
+			// Only meshes that were rebuilt get uploaded again; the rest are just drawn.
+			// Like the queries, only the global scene and the active one are drawn.
+			for (auto& entry : system.staticMeshes)
+			{
+				auto global = entry.second.find(0);
+				if (global != entry.second.end()) Game::main.renderer->Submit(global->second);
 
-				if (!isAffected)
-				{
-					minT = std::min(lastSafeT, minT);
-					break;
-				}
+				if (activeScene == 0) continue;
 
-				lastSafeT = j;
-			}
-			else
-			{
-				lastSafeT = j;
+				auto active = entry.second.find(activeScene);
+				if (active != entry.second.end()) Game::main.renderer->Submit(active->second);
 			}
 		}
-	}
-
-	if (minT == 0.0f) return;
+	});
+}
 
-	for (int i = 0; i < affectedCubes.size(); i++)
+void ECS::DispatchSystem(int index, float deltaTime)
+{
+	if (schedule[index].mainThread)
 	{
-		CubeComponent* cube = affectedCubes[i];
-		cubes[cube->x][cube->y][cube->z] = nullptr;
+		std::lock_guard<std::mutex> lock(mainThreadMutex);
+		mainThreadReady.push_back(index);
+		return;
 	}
 
-	// Now we need to figure out how the cube is gonna roll.
-	Quaternion newRotation = Util::GetRollRotation(oppFulcrum, roll, pos->quaternion, std::max(2, (int)(2 * (minT))));
-	Quaternion newRotation2 = Util::GetRollRotation(oppFulcrum, roll, newRotation, std::max(2, (int)(2 * (minT))));
-
-	// Then, we register the movements to the landing position with the active cube's movement component.
-	// The bezier curve is a little complicated.
-	glm::vec3 forward = Util::GetRelativeUp(roll);
-	if (forward.z != 0) forward *= -1.0f;
-	glm::vec3 up = Util::GetRelativeUp(oppFulcrum);
-	if (up.z != 0) up *= -1.0f;
-	float dist = glm::length(pos->position - landingWorldPosition);
-	float length = dist * cos(45) * (2.0 / 3.0f);
-	glm::vec3 p1 = pos->position + (forward * length);
-	glm::vec3 p2 = landingWorldPosition + (up * length);
+	ThreadPool::main.Submit([this, index, deltaTime] { RunSystem(index, deltaTime); });
+}
 
-	mover->RegisterMovement(3.5f, { { pos->position, p1, p2, landingWorldPosition } }, 1.0f);
-	mover->RegisterMovement(3.5f, { { pos->quaternion, newRotation, newRotation2 } }, 1.0f);
+void ECS::RunSystem(int index, float deltaTime)
+{
+	ScheduledSystem& s = schedule[index];
 
-	// And finally position the active cube in the right position.
-	MoveCube(activeCube, landingCubePosition.x, landingCubePosition.y, landingCubePosition.z);
+	s.update(activeScene, deltaTime);
 
-	// Oh, and we roll the actor onto the right face.
-	RollActor(actor, roll, oppFulcrum, standingFace, true);
-	/*actor->face = standingFace;
-	PositionActor(actor);*/
-	// actor->face = landingFace;
-
-	// But we can't forget that this might involve a larger structure of cubes.
-	// This is where things get a little complicated.
-	for (int j = 1; j < affectedCubes.size(); j++)
+	for (int i = 0; i < s.dependents.size(); i++)
 	{
-		// We need to grab the cube and position components, as well as their movement components.
-		CubeComponent* c = affectedCubes[j];
-		PositionComponent* pc = (PositionComponent*)c->entity->componentIDMap[positionComponentID];
-		MovementComponent* mc = (MovementComponent*)c->entity->componentIDMap[movementComponentID];
-
-		// There are two rotations necessary here.
-		// The first is the rotation of the actual position component.
-		Quaternion affRot = Util::GetRollRotation(oppFulcrum, roll, pc->quaternion, std::max(2, (int)(2 * (minT))));
-		Quaternion affRot2 = Util::GetRollRotation(oppFulcrum, roll, affRot, std::max(2, (int)(2 * (minT))));
-
-		// And the second is the rotation in space around the initial cube.
-		Quaternion diffRot = Util::GetRollRotation(oppFulcrum, roll, { 1, 0, 0, 0 }, 1);
-
-		// We need to record the initial difference in position between this cube
-		// and the cube we rolled earlier.
-		// We could've waited to finalize the movement of the "active" cube,
-		// but we'll instead make use of that handy pivot point we saved earlier.
-		int dX = pivotPos.x - c->x;
-		int dY = pivotPos.y - c->y;
-		int dZ = pivotPos.z - c->z;
-
-		// Now, we need to figure out what the difference should be after the rotation of the structure.
-		glm::vec3 newDifference = Util::Rotate(glm::vec3(dX, dY, dZ), diffRot);
-
-		// And then we need to convert that to world space, instead of cube space.
-		glm::vec3 worldDifference = CubeToWorldSpace(activeCube->x + (int)newDifference.x, activeCube->y + (int)newDifference.y, activeCube->z + (int)newDifference.z);
-
-		// Finally, we can register the necessary movements with the movement component and actually finalize the movement of the cube in cube space.
-		forward = Util::GetRelativeUp(roll);
-		if (forward.z != 0) forward *= -1.0f;
-		up = Util::GetRelativeUp(landingFace);
-		if (up.z != 0) up *= -1.0f;
-		dist = glm::length(pc->position - worldDifference);
-		length = dist * cos(45) * (2.0 / 3.0f);
-		p1 = pc->position + (forward * length);
-		p2 = worldDifference + (up * length);
-
-		BezierCurve b = { { pc->position, p1, p2, worldDifference } };
-		glm::vec3 cubeSpace = WorldToCubeSpace(b.GetPoint(minT));
-		glm::vec3 finalPoint = CubeToWorldSpace(cubeSpace.x, cubeSpace.y, cubeSpace.z);
-		dist = glm::length(pc->position - finalPoint);
-		length = dist * cos(45) * (2.0 / 3.0f);
-		p1 = pc->position + (forward * length);
-		p2 = finalPoint + (up * length);
-
-		/*CubeComponent* lastCube = affectedCubes[j - 1];
-		if (abs(cubeSpace.x - lastCube->x) + abs(cubeSpace.y - lastCube->y) + abs(cubeSpace.z - lastCube->z) > 1)
-		{
-			cubeSpace = (cubeSpace + glm::vec3(lastCube->x, lastCube->y, lastCube->z)) / 2.0f;
-		}*/
-		finalPoint = CubeToWorldSpace(cubeSpace.x, cubeSpace.y, cubeSpace.z);
-
-		mc->RegisterMovement(3.5f, { { pc->position, p1, p2, finalPoint } }, 1.0f);
-		mc->RegisterMovement(3.5f, { { pc->quaternion, affRot, affRot2 } }, 1.0f);
-		MoveCube(c, cubeSpace.x, cubeSpace.y, cubeSpace.z);
+		int d = s.dependents[i];
+		if (--waitingOn[d] == 0) DispatchSystem(d, deltaTime);
 	}
+
+	systemsLeft--;
 }
 
-void ECS::RollCube(ActorComponent* actor, Face rollDirection)
+void ECS::Update(float deltaTime)
 {
-	CubeComponent* activeCube = (CubeComponent*)actor->cube->componentIDMap[cubeComponentID];
-
-	// There are cubes to roll.
-
-	// We're (maybe) going to want to check possible landing points from non-initial circumstances, so
-	// we copy them into more variables so that we can change these while preserving the inputs.
-	Face activeFace = actor->face;
-	Face roll = rollDirection;
-
-	// All rotations expect a fulcrum.
-	std::pair<Face, bool> fulcrum = FindFulcrum(activeCube, activeFace, roll);
-	if (fulcrum.second == false) return;
-
-	glm::vec3 fulcrumPos = Util::GetRelativeUp(fulcrum.first) + glm::vec3(activeCube->x, activeCube->y, activeCube->z);
-	Entity* fulcrumEntity = cubes[(int)fulcrumPos.x][(int)fulcrumPos.y][(int)fulcrumPos.z];
-	CubeComponent* fulcrumCube = (CubeComponent*)fulcrumEntity->componentIDMap[cubeComponentID];
-	std::vector<CubeComponent*> affectedCubes = DetermineStructure(activeCube, fulcrumCube, rollDirection);
-
-	if (affectedCubes.size() > 0)
+	if (round < 2)
 	{
-		// Now that we know we have a fulcrum, we want to figure out the axis upon which the cube is rotating.
-		// This is a function of the position of the fulcrum, the face the player is standing on, and the roll direction.
-		roll = DetermineRollDirection(fulcrum.first, activeFace, roll);
+		round++;
+	}
 
-		// We need to make sure that the active cube *can* roll in that direction.
-		// If another cube is blocking it, the whole roll should be stopped.
-		// Let's check that. We don't need any fancy function for this, just:
-		glm::vec3 rollUp = Util::GetRelativeUp(roll);
-		Entity* possibleBlockerEntity = GetCube(activeCube->x + (int)rollUp.x, activeCube->y + (int)rollUp.y, activeCube->z + (int)rollUp.z);
+	if (round == 1)
+	{
+		float cubeSize = (float)this->cubeSize;
+		int mapWidth = 5;
+		int mapHeight = 5;
+		int mapDepth = 5;
 
-		/*bool blocked = false;
+		// The grid has no edges any more, but the level stays centred where it was
+		// in the old 100^3 array so that world positions don't move.
+		int midMaxX = 50 - (mapWidth / 2);
+		int midMaxY = 50 - (mapHeight / 2);
+		int midMaxZ = 50 - (mapDepth / 2);
 
-		if (possibleBlockerEntity != nullptr && affectedCubes.size() > 1)
+		for (int x = 0; x < mapWidth; x++)
 		{
-			CubeComponent* possibleBlocker = (CubeComponent*)possibleBlockerEntity->componentIDMap[cubeComponentID];
-
-			auto result = std::find(affectedCubes.begin(), affectedCubes.end(), possibleBlocker);
-
-			if (result == affectedCubes.end())
+			for (int y = 0; y < mapHeight; y++)
 			{
-				blocked = true;
+				for (int z = 0; z < mapDepth; z++)
+				{
+					Entity* cube = CreateEntity(0, "Cube");
+					ECS::main.RegisterComponent(new PositionComponent(cube, true, glm::vec3(0.0f, 0.0f, 0.0f), { 1, 0, 0, 0 }), cube);
+					ECS::main.RegisterComponent(new CubeComponent(cube, true, x + midMaxX, y + midMaxY, z + midMaxZ, glm::vec3(cubeSize, cubeSize, cubeSize), glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), Game::main.textureMap["test"]), cube);
+					ECS::main.PositionCube(cube->Get<CubeComponent>(), x + midMaxX, y + midMaxY, z + midMaxZ);
+					ECS::main.RegisterComponent(new MovementComponent(cube, true), cube);
+					ECS::main.sim.Place(x + midMaxX, y + midMaxY, z + midMaxZ, cube->GetHandle());
+				}
 			}
-		}*/
-
-		if (possibleBlockerEntity != nullptr) return;
-
-		// Next we need to see if the block right above that is blocked.
-
-		glm::vec3 standUp = Util::GetRelativeUp(actor->face);
-		Entity* possibleBlockerEntity2 = GetCube(activeCube->x + (int)rollUp.x + (int)standUp.x,
-			activeCube->y + (int)rollUp.y + (int)standUp.y,
-			activeCube->z + (int)rollUp.z + (int)standUp.z);
-
-		bool blocked = false;
+		}
 
-		if (possibleBlockerEntity2 != nullptr && affectedCubes.size() > 1)
+		for (int x = 0; x < mapWidth; x++)
 		{
-			CubeComponent* possibleBlocker = (CubeComponent*)possibleBlockerEntity2->componentIDMap[cubeComponentID];
-
-			auto result = std::find(affectedCubes.begin(), affectedCubes.end(), possibleBlocker);
-
-			if (result == affectedCubes.end())
+			for (int i = 1; i < 10; i++)
 			{
-				blocked = true;
+				Entity* cube = CreateEntity(0, "Cube");
+				ECS::main.RegisterComponent(new PositionComponent(cube, true, glm::vec3(0.0f, 0.0f, 0.0f), { 1, 0, 0, 0 }), cube);
+				ECS::main.RegisterComponent(new CubeComponent(cube, true, x + midMaxX, -i + midMaxY, mapDepth - 1 + midMaxZ, glm::vec3(cubeSize, cubeSize, cubeSize), glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), Game::main.textureMap["block"]), cube);
+				ECS::main.PositionCube(cube->Get<CubeComponent>(), x + midMaxX, -i + midMaxY, mapDepth - 1 + midMaxZ);
+				ECS::main.RegisterComponent(new MovementComponent(cube, true), cube);
+				ECS::main.sim.Place(x + midMaxX, -i + midMaxY, mapDepth - 1 + midMaxZ, cube->GetHandle());
 			}
 		}
 
-		if (possibleBlockerEntity2 != nullptr && blocked) return;
+		// The level went straight into the grid, so work out every face mask in one go.
+		RefreshAllFaces();
+
+		/*Entity* cube = CreateEntity(0, "Cube");
+		ECS::main.RegisterComponent(new PositionComponent(cube, true, glm::vec3(0.0f, 0.0f, 0.0f), { 1, 0, 0, 0 }), cube);
+		ECS::main.RegisterComponent(new CubeComponent(cube, true, 1 + midMaxX, midMaxY + mapHeight - 3, midMaxZ - 1, glm::vec3(cubeSize, cubeSize, cubeSize), glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), Game::main.textureMap["test"]), cube);
+		ECS::main.PositionCube(cube->Get<CubeComponent>(), 1 + midMaxX, midMaxY + mapHeight - 3, midMaxZ - 1);
+		ECS::main.RegisterComponent(new MovementComponent(cube, true), cube);
+		ECS::main.sim.Place(1 + midMaxX, midMaxY + mapHeight - 3, midMaxZ - 1, cube->GetHandle());*/
 
-		// Now, we have the "real" direction we're going to be rolling.
-		// We want to figure out where we're going to land.
-		// This is a function of the fulcrum and the roll direction.
-		// We always want to roll "towards" the fulcrum.
-		glm::vec3 landingCoords = Util::GetLandingCoords(fulcrum.first, roll) + glm::vec3(activeCube->x, activeCube->y, activeCube->z);
+		Entity* playerEntity = CreateEntity(0, "Player");
+		player = playerEntity->GetHandle();
+		Animation* testIdle = Game::main.animationMap["testIdle"];
 
-		// Now we need to see if there is a cube there for us to land on.
-		Entity* landingTarget = GetCube(landingCoords.x, landingCoords.y, landingCoords.z);
-		Face landingFace;
+		ECS::main.RegisterComponent(new PositionComponent(playerEntity, true, glm::vec3(0.0f, 0.0f, 0.0f), { 1, 0, 0, 0 }), playerEntity);
+		ECS::main.RegisterComponent(new CameraFollowComponent(playerEntity, true, { -1.0f, 0.0f, 0.0f, 0.0f }, 500.0f, 40.0f, true, false, false, false), playerEntity);
+		ECS::main.RegisterComponent(new InputComponent(playerEntity, true, true, 0.5f, 0.5f), playerEntity);
+		ECS::main.RegisterComponent(new ActorComponent(playerEntity, true, 10.0f, Face::back, ECS::main.sim.grid.Get((mapWidth / 2) + midMaxX, midMaxY - 1, mapDepth - 1 + midMaxZ)), playerEntity);
+		ECS::main.RegisterComponent(new MovementComponent(playerEntity, true), playerEntity);
+		ECS::main.RegisterComponent(new ModelComponent(playerEntity, true, Game::main.modelMap["test"], { 0.0f, 2.0f, 0.0f }, {0.5f, 0.5f, 0.5f, 1.0f}, {5.0f, 5.0f, 5.0f}), playerEntity);
 
-		// If there is a cube there, we can stop now and (check something, then) initiate the actual roll.
-		if (landingTarget != nullptr)
-		{
-			// The face we're landing on is the opposite of the fulcrum.
-			// At least so long as we're doing only a 90 degree rotation.
-			landingFace = Util::OppositeFace(fulcrum.first);
+		PositionActor(playerEntity->Get<ActorComponent>());
 
-			// We need to make sure that the player won't get stuck on any cubes while rolling.
-			CubeComponent* landingCube = (CubeComponent*)landingTarget->componentIDMap[cubeComponentID];
-			glm::vec3 landingUp = Util::GetRelativeUp(landingFace);
-			glm::vec3 landingCubePosition = glm::vec3(landingCube->x + (int)landingUp.x, landingCube->y + (int)landingUp.y, landingCube->z + (int)landingUp.z);
+		glm::vec3 possPos = ECS::main.CubeToWorldSpace((mapWidth / 2) + midMaxX, midMaxY - 1, mapDepth - 1 + midMaxZ);
 
-			standUp = Util::GetRelativeUp(rollDirection);
-			Entity* possibleBlockerEntity3 = GetCube(landingCubePosition.x + (int)standUp.x, landingCubePosition.y + (int)standUp.y, landingCubePosition.z + (int)standUp.z);
+		Game::main.cameraPosition += possPos;
+	}
 
-			if (possibleBlockerEntity3 != nullptr) return;
+	RunSystems(deltaTime);
+	SubmitRenderBuffers();
 
-			QuarterRoll(actor, rollDirection, roll, landingTarget, landingFace, affectedCubes);
-			return;
-		}
+	// The sync point: every system is done, so structural changes can land all at once.
+	commands.Playback(*this);
+}
 
-		// It is a real shame that our rotation couldn't be that simple.
-		// If we've gotten here, it means there isn't a cube for ours to land on.
-		// That means we need to rotate another 90 degrees.
-		// Luckily, a cube can only rotate 180 degrees, no more, so we only need
-		// to do one more check.
-
-		// Well, we actually know that if we have gotten this far there is somewhere for
-		// the cube to land: the fulcrum itself. The landing face is just going to be
-		// the rolling direction.
-		landingCoords = glm::vec3(activeCube->x, activeCube->y, activeCube->z) + Util::GetRelativeUp(fulcrum.first);
-		landingTarget = GetCube(landingCoords.x, landingCoords.y, landingCoords.z);
-
-		// Voila, easy as that.
-		// And if there is something for us to land on there, let's do it.
-		if (landingTarget != nullptr && affectedCubes.size() == 1)
-		{
-			// We need to make sure that the player won't get stuck on any cubes while rolling.
-			CubeComponent* landingCube = (CubeComponent*)landingTarget->componentIDMap[cubeComponentID];
-			glm::vec3 landingUp = Util::GetRelativeUp(roll);
-			glm::vec3 landingCubePosition = glm::vec3(landingCube->x + (int)landingUp.x, landingCube->y + (int)landingUp.y, landingCube->z + (int)landingUp.z);
+void ECS::AddDeadEntity(Entity* e)
+{
+	commands.DestroyEntity(e->GetHandle());
+}
 
-			standUp = Util::GetRelativeUp(Util::OppositeFace(actor->face));
-			Entity* possibleBlockerEntity3 = GetCube(landingCubePosition.x + (int)standUp.x, landingCubePosition.y + (int)standUp.y, landingCubePosition.z + (int)standUp.z);
+Entity* ECS::CreateEntity(int scene, const std::string& name)
+{
+	// Reuse a freed slot if there is one; its generation was already bumped when it was freed.
+	if (freeSlots.size() > 0)
+	{
+		uint32_t index = freeSlots.back();
+		freeSlots.pop_back();
 
-			if (possibleBlockerEntity3 != nullptr) return;
+		Entity& e = entities[index];
+		e = Entity(e.GetHandle(), scene, name);
+		return &e;
+	}
 
-			// We can assume that the landing face is the same as our roll direction.
+	uint32_t index = (uint32_t)entities.size();
 
-			HalfRoll(actor, Util::OppositeFace(actor->face), Util::OppositeFace(fulcrum.first), roll, landingTarget, roll, affectedCubes);
-			return;
-		}
+	// A handle only has room for indices up to indexMask; any further and new slots would alias old ones.
+	if (index > EntityHandle::indexMask)
+	{
+		std::cout << "The entity table is full at " << index << " entities." << '\n';
+		std::abort();
 	}
 
-	// This means we couldn't find a suitable landing position and thus shouldn't roll the cubes at all.
-	// Oh well, better luck next time.
-	return;
+	entities.emplace_back(EntityHandle::Make(index, 1), scene, name);
+	return &entities.back();
 }
 
-void ECS::RollActor(ActorComponent* actor, Face rollDirection, Face landingFace, Face standingFace, bool half)
+Entity* ECS::GetEntity(EntityHandle handle)
 {
-	PositionComponent* pos = (PositionComponent*)actor->entity->componentIDMap[positionComponentID];
-	MovementComponent* mover = (MovementComponent*)actor->entity->componentIDMap[movementComponentID];
-	CubeComponent* cube = (CubeComponent*)actor->cube->componentIDMap[cubeComponentID];
-
-	Quaternion r = Util::GetRollRotation(landingFace, rollDirection, pos->quaternion, 2);
-	glm::vec3 endPos = CubeToWorldSpace(cube->x, cube->y, cube->z) + Util::Rotate(glm::vec3(0.0f, (float)cubeSize, 0.0f), Util::GetQuaternionFromFace(standingFace));
-
-	glm::vec3 forward = Util::GetRelativeUp(rollDirection);
-	if (forward.z != 0) forward *= -1.0f;
-	glm::vec3 up = Util::GetRelativeUp(landingFace);
-	if (up.z != 0) up *= -1.0f;
-	float dist = glm::length(pos->position - endPos);
-	float length = dist * cos(45) * (2.0 / 3.0f);
-	glm::vec3 p1 = pos->position + (forward * length);
-	glm::vec3 p2 = endPos + (up * length);
-
-	mover->RegisterMovement(3.5f, { { pos->position, p1, p2, endPos } }, 1.0f);
+	uint32_t index = handle.Index();
 
-	if (half)
+	if (handle.IsNull() || index >= entities.size())
 	{
-		Quaternion r2 = Util::GetRollRotation(landingFace, rollDirection, r, 2);
-		mover->RegisterMovement(3.5f, { {pos->quaternion, r, r2 } }, 1.0f);
+		return nullptr;
 	}
-	else
+
+	Entity* e = &entities[index];
+
+	// A mismatched generation means the entity this handle pointed to is gone.
+	if (e->GetHandle() != handle)
 	{
-		mover->RegisterMovement(3.5f, { { pos->quaternion, r } }, 1.0f);
+		return nullptr;
 	}
 
-	actor->face = standingFace;
+	return e;
 }
 
-#pragma endregion
-
-#pragma region Entities
-
-int Entity::GetID() { return ID; }
-int Entity::GetScene() { return scene; }
-std::string Entity::GetName() { return name;  }
-
-void Entity::SetID(int ID) { this->ID = ID; }
-void Entity::SetScene(int scene) { this->scene = scene; }
-void Entity::SetName(std::string name) { this->name = name; }
-
-Entity::Entity(int ID, int scene, std::string name)
+void ECS::DeleteEntity(Entity* e)
 {
-	this->ID = ID;
-	this->scene = scene;
-	this->name = name;
-};
+	// Only the systems the entity was actually handed to need to hear about it,
+	// and each of those can drop it without a scan.
+	ForEachSystem([&](auto& system)
+	{
+		constexpr uint32_t signature = decltype(system.query)::signature;
 
-#pragma endregion
+		if ((e->signature & signature) == signature)
+		{
+			system.query.Remove(e);
+		}
+	});
 
-#pragma region Component Blocks
+	// A cube left in the grid would stay solid to the sim, and keep being drawn, after it's gone.
+	// The cell only goes if it's still this cube's; something else may have moved in since.
+	CubeComponent* cube = e->Get<CubeComponent>();
 
-void ComponentBlock::Update(int activeScene, float deltaTime)
-{
-	system->Update(activeScene, deltaTime);
-}
-void ComponentBlock::AddComponent(Component* c)
-{
-	system->AddComponent(c);
-}
-void ComponentBlock::PurgeEntity(Entity* e)
-{
-	system->PurgeEntity(e);
-}
-ComponentBlock::ComponentBlock(System* system, int componentID)
-{
-	this->system = system;
-	this->componentID = componentID;
-}
+	if (cube != nullptr && sim.grid.Get(cube->x, cube->y, cube->z) == e->GetHandle())
+	{
+		sim.Remove(cube->x, cube->y, cube->z);
+		RefreshFaces(cube->x, cube->y, cube->z);
+	}
 
-#pragma endregion
+	// The entity owns its components, including the ones no system holds onto.
+	for (int i = 0; i < e->components.size(); i++)
+	{
+		delete e->components[i];
+	}
 
-#pragma region ECS
+	EntityHandle handle = e->GetHandle();
+	uint32_t generation = handle.Generation() + 1;
+	if (generation > EntityHandle::maxGeneration) generation = 1;
 
-uint32_t ECS::GetID()
-{
-	return ++entityIDCounter;
+	// Free slots get scene -1 so that nothing scene-wide mistakes them for live entities.
+	*e = Entity(EntityHandle::Make(handle.Index(), generation), -1, "");
+	freeSlots.push_back(handle.Index());
 }
 
-uint32_t ECS::GetOtherID()
+void ECS::DeleteEntities(const std::vector<Entity*>& es)
 {
-	return ++otherIDCounter;
+	for (int i = 0; i < es.size(); i++)
+	{
+		DeleteEntity(es[i]);
+	}
 }
 
-void ECS::Init()
+void ECS::DeleteScene(int scene)
 {
-	componentBlocks.push_back(new ComponentBlock(new InputSystem(), inputComponentID));
-	componentBlocks.push_back(new ComponentBlock(new MovementSystem(), movementComponentID));
-	componentBlocks.push_back(new ComponentBlock(new CubeSystem(), cubeComponentID));
-	componentBlocks.push_back(new ComponentBlock(new ModelSystem(), modelComponentID));
-	componentBlocks.push_back(new ComponentBlock(new AnimationControllerSystem(), animationControllerComponentID));
-	componentBlocks.push_back(new ComponentBlock(new AnimationSystem(), animationComponentID));
-	componentBlocks.push_back(new ComponentBlock(new BillboardingSystem(), billboardingComponentID));
-	componentBlocks.push_back(new ComponentBlock(new CameraFollowSystem(), cameraFollowComponentID));
-	componentBlocks.push_back(new ComponentBlock(new TurnSystem(), actorComponentID));
+	// One pass over the entity table; each deletion is constant time, cubes coming out of the
+	// sim's grid included, so unloading a level is linear in the number of entities in it.
+	for (int i = 0; i < entities.size(); i++)
+	{
+		if (entities[i].GetScene() == scene)
+		{
+			DeleteEntity(&entities[i]);
+		}
+	}
 }
 
-void ECS::Update(float deltaTime)
+void ECS::ChangeScene(Entity* e, int scene)
 {
-	if (round < 2)
+	// Every query keeps its rows partitioned by scene, so the entity leaves
+	// each system under its old scene and rejoins under the new one.
+	ForEachSystem([&](auto& system)
 	{
-		round++;
-	}
+		constexpr uint32_t signature = decltype(system.query)::signature;
 
-	if (round == 1)
-	{
-		float cubeSize = (float)this->cubeSize;
-		int mapWidth = 5;
-		int mapHeight = 5;
-		int mapDepth = 5;
+		if ((e->signature & signature) == signature)
+		{
+			system.query.Remove(e);
+		}
+	});
 
-		int midMaxX = (ECS::main.maxWidth / 2) - (mapWidth / 2);
-		int midMaxY = (ECS::main.maxHeight / 2) - (mapHeight / 2);
-		int midMaxZ = (ECS::main.maxDepth / 2) - (mapDepth / 2);
+	e->SetScene(scene);
 
-		for (int x = 0; x < mapWidth; x++)
+	// A resting cube is meshed with its scene's cubes, so its chunk needs meshing again.
+	CubeComponent* cube = e->Get<CubeComponent>();
+	if (cube != nullptr && sim.grid.Get(cube->x, cube->y, cube->z) == e->GetHandle()) sim.grid.MarkDirty(cube->x, cube->y, cube->z);
+
+	ForEachSystem([&](auto& system)
+	{
+		constexpr uint32_t signature = decltype(system.query)::signature;
+
+		if ((e->signature & signature) == signature)
 		{
-			for (int y = 0; y < mapHeight; y++)
-			{
-				for (int z = 0; z < mapDepth; z++)
-				{
-					Entity* cube = CreateEntity(0, "Cube: " + std::to_string(x + midMaxX) + std::to_string(y + midMaxY) + " / " + std::to_string(z + midMaxZ));
-					ECS::main.RegisterComponent(new PositionComponent(cube, true, glm::vec3(0.0f, 0.0f, 0.0f), { 1, 0, 0, 0 }), cube);
-					ECS::main.RegisterComponent(new CubeComponent(cube, true, x + midMaxX, y + midMaxY, z + midMaxZ, glm::vec3(cubeSize, cubeSize, cubeSize), glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), Game::main.textureMap["test"]), cube);
-					ECS::main.PositionCube((CubeComponent*)cube->componentIDMap[cubeComponentID], x + midMaxX, y + midMaxY, z + midMaxZ);
-					ECS::main.RegisterComponent(new MovementComponent(cube, true), cube);
-					ECS::main.cubes[x + midMaxX][y + midMaxY][z + midMaxZ] = cube;
-				}
-			}
+			system.query.Add(e);
 		}
+	});
+}
+
+void ECS::RemoveComponent(Entity* entity, int componentID)
+{
+	uint32_t bit = 1u << componentID;
+	if ((entity->signature & bit) == 0) return;
+
+	// Any system that had the whole entity loses it as soon as one of its components goes.
+	ForEachSystem([&](auto& system)
+	{
+		constexpr uint32_t signature = decltype(system.query)::signature;
 
-		for (int x = 0; x < mapWidth; x++)
+		if ((signature & bit) != 0 &&
+			(entity->signature & signature) == signature)
 		{
-			for (int i = 1; i < 10; i++)
-			{
-				Entity* cube = CreateEntity(0, "Cube: " + std::to_string(x + midMaxX) + " / " + std::to_string(-i + midMaxY) + " / " + std::to_string(mapDepth - 1 + midMaxZ));
-				ECS::main.RegisterComponent(new PositionComponent(cube, true, glm::vec3(0.0f, 0.0f, 0.0f), { 1, 0, 0, 0 }), cube);
-				ECS::main.RegisterComponent(new CubeComponent(cube, true, x + midMaxX, -i + midMaxY, mapDepth - 1 + midMaxZ, glm::vec3(cubeSize, cubeSize, cubeSize), glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), Game::main.textureMap["block"]), cube);
-				ECS::main.PositionCube((CubeComponent*)cube->componentIDMap[cubeComponentID], x + midMaxX, -i + midMaxY, mapDepth - 1 + midMaxZ);
-				ECS::main.RegisterComponent(new MovementComponent(cube, true), cube);
-				ECS::main.cubes[x + + midMaxX][-i + midMaxY][mapDepth - 1 + midMaxZ] = cube;
-			}
+			system.query.Remove(entity);
 		}
+	});
 
-		/*Entity* cube = CreateEntity(0, "Cube: " + std::to_string(1 + midMaxX) + std::to_string(midMaxY + mapHeight - 3) + " / " + std::to_string(midMaxZ - 1));
-		ECS::main.RegisterComponent(new PositionComponent(cube, true, glm::vec3(0.0f, 0.0f, 0.0f), { 1, 0, 0, 0 }), cube);
-		ECS::main.RegisterComponent(new CubeComponent(cube, true, 1 + midMaxX, midMaxY + mapHeight - 3, midMaxZ - 1, glm::vec3(cubeSize, cubeSize, cubeSize), glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), Game::main.textureMap["test"]), cube);
-		ECS::main.PositionCube((CubeComponent*)cube->componentIDMap[cubeComponentID], 1 + midMaxX, midMaxY + mapHeight - 3, midMaxZ - 1);
-		ECS::main.RegisterComponent(new MovementComponent(cube, true), cube);
-		ECS::main.cubes[1 + midMaxX][midMaxY + mapHeight - 3][midMaxZ - 1] = cube;*/
-
-		player = CreateEntity(0, "Player");
-		Animation* testIdle = Game::main.animationMap["testIdle"];
+	Component* component = entity->componentIDMap[componentID];
 
-		ECS::main.RegisterComponent(new PositionComponent(player, true, glm::vec3(0.0f, 0.0f, 0.0f), { 1, 0, 0, 0 }), player);
-		ECS::main.RegisterComponent(new CameraFollowComponent(player, true, { -1.0f, 0.0f, 0.0f, 0.0f }, 500.0f, 40.0f, true, false, false, false), player);
-		ECS::main.RegisterComponent(new InputComponent(player, true, true, 0.5f, 0.5f), player);
-		ECS::main.RegisterComponent(new ActorComponent(player, true, 10.0f, Face::back, ECS::main.cubes[(mapWidth / 2) + midMaxX][midMaxY - 1][mapDepth - 1 + midMaxZ]), player);
-		ECS::main.RegisterComponent(new MovementComponent(player, true), player);
-		ECS::main.RegisterComponent(new ModelComponent(player, true, Game::main.modelMap["test"], { 0.0f, 2.0f, 0.0f }, {0.5f, 0.5f, 0.5f, 1.0f}, {5.0f, 5.0f, 5.0f}), player);
+	entity->components.erase(std::remove(entity->components.begin(), entity->components.end(), component), entity->components.end());
+	entity->componentIDMap[componentID] = nullptr;
+	entity->signature &= ~bit;
 
-		PositionActor((ActorComponent*)player->componentIDMap[actorComponentID]);
+	delete component;
+}
 
-		glm::vec3 possPos = ECS::main.CubeToWorldSpace((mapWidth / 2) + midMaxX, midMaxY - 1, mapDepth - 1 + midMaxZ);
+bool ECS::RegisterComponent(Component* component, Entity* entity)
+{
+	uint32_t bit = 1u << component->ID;
 
-		Game::main.cameraPosition += possPos;
-	}
+	// An entity only ever holds one component of each type. The caller still owns a component turned away.
+	if ((entity->signature & bit) != 0) return false;
 
-	for (int i = 0; i < componentBlocks.size(); i++)
+	entity->components.push_back(component);
+	entity->componentIDMap[component->ID] = component;
+	entity->signature |= bit;
+
+	// Systems join on several component types, so rather than handing the component
+	// to a system straight away, we wait until the entity's signature covers everything
+	// the system's query reads. That way each system resolves its columns once, here,
+	// instead of looking them up per entity every frame.
+	ForEachSystem([&](auto& system)
 	{
-		componentBlocks[i]->Update(activeScene, deltaTime);
-	}
+		constexpr uint32_t signature = decltype(system.query)::signature;
 
-	PurgeDeadEntities();
+		if ((signature & bit) != 0 &&
+			(entity->signature & signature) == signature)
+		{
+			system.query.Add(entity);
+		}
+	});
+
+	return true;
 }
 
-void ECS::AddDeadEntity(Entity* e)
+#pragma endregion
+
+#pragma region Command Buffer
+
+void CommandBuffer::Record(EntityCommand command)
 {
-	if (std::find(dyingEntities.begin(), dyingEntities.end(), e) == dyingEntities.end())
-	{
-		dyingEntities.push_back(e);
-	}
+	std::lock_guard<std::mutex> lock(mutex);
+	commands.push_back(std::move(command));
 }
 
-void ECS::PurgeDeadEntities()
+EntityHandle CommandBuffer::CreateEntity(int scene, std::string name)
 {
-	if (dyingEntities.size() > 0)
-	{
-		size_t n = dyingEntities.size();
+	std::lock_guard<std::mutex> lock(mutex);
 
-		for (int i = 0; i < n; i++)
-		{
-			DeleteEntity(dyingEntities[i]);
-		}
+	EntityCommand command;
+	command.type = CommandType::createEntity;
+	command.entity = EntityHandle::Make(++pendingCount, 0);
+	command.scene = scene;
+	command.name = std::move(name);
 
-		dyingEntities.clear();
-	}
+	commands.push_back(std::move(command));
+	return commands.back().entity;
 }
 
-Entity* ECS::CreateEntity(int scene, std::string name)
+void CommandBuffer::DestroyEntity(EntityHandle entity)
 {
-	Entity* e = new Entity(GetID(), scene, name);
-	return e;
+	EntityCommand command;
+	command.type = CommandType::destroyEntity;
+	command.entity = entity;
+
+	Record(std::move(command));
 }
 
-void ECS::DeleteEntity(Entity* e)
+void CommandBuffer::AddComponent(EntityHandle entity, Component* component)
 {
-	for (int i = 0; i < componentBlocks.size(); i++)
-	{
-		componentBlocks[i]->PurgeEntity(e);
-	}
+	EntityCommand command;
+	command.type = CommandType::addComponent;
+	command.entity = entity;
+	command.component = component;
+	command.componentID = component->ID;
 
-	delete e;
+	Record(std::move(command));
 }
 
-void ECS::RegisterComponent(Component* component, Entity* entity)
+void CommandBuffer::RemoveComponent(EntityHandle entity, int componentID)
 {
-	entity->components.push_back(component);
-	entity->componentIDMap.emplace(component->ID, component);
+	EntityCommand command;
+	command.type = CommandType::removeComponent;
+	command.entity = entity;
+	command.componentID = componentID;
+
+	Record(std::move(command));
+}
+
+void CommandBuffer::Playback(ECS& ecs)
+{
+	std::vector<EntityCommand> batch;
+	uint32_t pending;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		batch.swap(commands);
+		pending = pendingCount;
+		pendingCount = 0;
+	}
+
+	if (batch.size() == 0) return;
 
-	for (int i = 0; i < componentBlocks.size(); i++)
+	// Creations go first, so every pending handle resolves. After that the batch is grouped by entity, and
+	// the sort is stable, so an entity's commands run in the order they were recorded in: removing a
+	// component and adding a new one of the same type in one frame leaves the new one.
+	std::stable_sort(batch.begin(), batch.end(), [](const EntityCommand& a, const EntityCommand& b)
 	{
-		if (componentBlocks[i]->componentID == component->ID)
+		bool aCreates = a.type == CommandType::createEntity;
+		bool bCreates = b.type == CommandType::createEntity;
+
+		if (aCreates != bCreates) return aCreates;
+		return a.entity.value < b.entity.value;
+	});
+
+	// Pending handles index straight into this, so resolving one is a lookup rather than a search.
+	std::vector<Entity*> created(pending + 1, nullptr);
+
+	auto resolve = [&](EntityHandle handle) -> Entity*
+	{
+		if (IsPending(handle)) return created[handle.Index()];
+		return ecs.GetEntity(handle);
+	};
+
+	for (int i = 0; i < batch.size(); i++)
+	{
+		EntityCommand& command = batch[i];
+
+		if (command.type == CommandType::createEntity)
+		{
+			created[command.entity.Index()] = ecs.CreateEntity(command.scene, command.name);
+		}
+		else if (command.type == CommandType::addComponent)
+		{
+			Entity* e = resolve(command.entity);
+
+			// The component was made for an entity that no longer exists, so nobody else will free it.
+			if (e == nullptr)
+			{
+				delete command.component;
+				continue;
+			}
+
+			// Nor will it be freed if the entity already has one of its type.
+			command.component->entity = e;
+			if (!ecs.RegisterComponent(command.component, e)) delete command.component;
+		}
+		else if (command.type == CommandType::removeComponent)
+		{
+			Entity* e = resolve(command.entity);
+			if (e != nullptr) ecs.RemoveComponent(e, command.componentID);
+		}
+		else if (command.type == CommandType::destroyEntity)
 		{
-			componentBlocks[i]->AddComponent(component);
-			return;
+			// A repeated destroy finds the generation already bumped and resolves to nothing.
+			Entity* e = resolve(command.entity);
+			if (e != nullptr) ecs.DeleteEntity(e);
 		}
 	}
 }
@@ -1089,7 +917,7 @@ CubeComponent::CubeComponent(Entity* entity, bool active, int x, int y, int z, g
 	this->color = color;
 	this->texture = texture;
 
-	this->checked = false;
+	this->exposedFaces = VoxelGrid::allFaces;
 }
 
 #pragma endregion
@@ -1210,7 +1038,7 @@ BillboardingComponent::BillboardingComponent(Entity* entity, bool active)
 
 #pragma region Actor Component
 
-ActorComponent::ActorComponent(Entity * entity, bool active, float speed, Face face, Entity * cube)
+ActorComponent::ActorComponent(Entity * entity, bool active, float speed, Face face, EntityHandle cube)
 {
 	this->ID = actorComponentID;
 	this->entity = entity;
@@ -1235,15 +1063,38 @@ MovementComponent::MovementComponent(Entity* entity, bool active)
 	this->moving = false;
 }
 
+MovementComponent::~MovementComponent()
+{
+	for (int i = 0; i < queue.size(); i++)
+	{
+		delete queue[i];
+	}
+}
+
+void MovementComponent::SetMoving(bool moving)
+{
+	this->moving = moving;
+
+	// A cube's moving bit lives in the grid too, as long as the cube is still in its cell.
+	CubeComponent* cube = entity->Get<CubeComponent>();
+
+	if (cube != nullptr &&
+		ECS::main.sim.grid.Get(cube->x, cube->y, cube->z) == entity->GetHandle())
+	{
+		ECS::main.sim.grid.SetMoving(cube->x, cube->y, cube->z, moving);
+		ECS::main.RefreshFaces(cube->x, cube->y, cube->z);
+	}
+}
+
 void MovementComponent::RegisterMovement(float speed, BezierCurve curve, float targetT)
 {
-	this->moving = true;
+	SetMoving(true);
 
 	BezierMovement* m = new BezierMovement();
 	m->ID = ECS::main.GetOtherID();
 	m->movementType = MovementType::bezier;
 	m->speed = speed;
-	m->curve = curve;
+	m->curve = std::move(curve);
 	m->t = 0.0f;
 	m->targetT = targetT;
 	this->queue.push_back(m);
@@ -1251,7 +1102,7 @@ void MovementComponent::RegisterMovement(float speed, BezierCurve curve, float t
 
 void MovementComponent::RegisterMovement(float speed, glm::vec3 target)
 {
-	this->moving = true;
+	SetMoving(true);
 
 	LinearMovement* m = new LinearMovement();
 	m->ID = ECS::main.GetOtherID();
@@ -1263,7 +1114,7 @@ void MovementComponent::RegisterMovement(float speed, glm::vec3 target)
 
 void MovementComponent::RegisterMovement(float speed, Quaternion target)
 {
-	this->moving = true;
+	SetMoving(true);
 
 	RotatingMovement* m = new RotatingMovement();
 	m->ID = ECS::main.GetOtherID();
@@ -1275,13 +1126,13 @@ void MovementComponent::RegisterMovement(float speed, Quaternion target)
 
 void MovementComponent::RegisterMovement(float speed, BezierQuaternion curve, float targetT)
 {
-	this->moving = true;
+	SetMoving(true);
 
 	BezierRotatingMovement* m = new BezierRotatingMovement();
 	m->ID = ECS::main.GetOtherID();
 	m->movementType = MovementType::bezierRotation;
 	m->speed = speed;
-	m->curve = curve;
+	m->curve = std::move(curve);
 	m->targetT = targetT;
 	this->queue.push_back(m);
 }
@@ -1314,94 +1165,233 @@ ModelComponent::ModelComponent(Entity* entity, bool active, Model* model, glm::v
 
 void CubeSystem::Update(int activeScene, float deltaTime)
 {
-	for (int i = 0; i < cubes.size(); i++)
+	VoxelGrid& grid = ECS::main.sim.grid;
+
+	// Chunks that emptied out were freed, so they never show up as dirty; blank their meshes instead.
+	// The meshes (and their buffers) stay around in case the chunk fills up again.
+	grid.TakeFreedChunks(freedChunks);
+
+	for (int i = 0; i < freedChunks.size(); i++)
 	{
-		CubeComponent* cube = cubes[i];
+		auto result = staticMeshes.find(freedChunks[i]);
+		if (result == staticMeshes.end()) continue;
 
-		if (cube->active && cube->entity->GetScene() == activeScene ||
-			cube->active && cube->entity->GetScene() == 0)
+		for (auto& entry : result->second)
 		{
-			PositionComponent* pos = (PositionComponent*)cube->entity->componentIDMap[positionComponentID];
+			if (entry.second.ranges.size() == 0) continue;
 
-			Entity* up = nullptr;
-			if (cube->y + 1 < ECS::main.maxHeight)
-			{
-				up = ECS::main.cubes[cube->x + 0][cube->y + 1][cube->z + 0];
-				if (up != nullptr) { MovementComponent* m = (MovementComponent*)up->componentIDMap[movementComponentID]; if (m->moving) { up = nullptr; } }
-			}
+			entry.second.Begin();
+			entry.second.End();
+		}
+	}
 
-			Entity* down = nullptr;
-			if (cube->y - 1 > 0)
-			{
-				down = ECS::main.cubes[cube->x + 0][cube->y - 1][cube->z + 0];
-				if (down != nullptr) { MovementComponent* m = (MovementComponent*)down->componentIDMap[movementComponentID]; if (m->moving) { down = nullptr; } }
-			}
+	// Find the chunks that changed since the last frame. The map of meshes is only added to here,
+	// so each chunk's meshes can be rebuilt on any thread.
+	grid.CollectChunks(gridChunks);
+	dirtyChunks.clear();
 
-			Entity* right = nullptr;
-			if (cube->x + 1 < ECS::main.maxWidth)
-			{
-				right = ECS::main.cubes[cube->x + 1][cube->y + 0][cube->z + 0];
-				if (right != nullptr) { MovementComponent* m = (MovementComponent*)right->componentIDMap[movementComponentID]; if (m->moving) { right = nullptr; } }
-			}
+	for (int i = 0; i < gridChunks.size(); i++)
+	{
+		VoxelGrid::Chunk* chunk = gridChunks[i];
+		if (!chunk->dirty) continue;
 
-			Entity* left = nullptr;
-			if (cube->x - 1 > 0)
-			{
-				left = ECS::main.cubes[cube->x - 1][cube->y + 0][cube->z + 0];
-				if (left != nullptr) { MovementComponent* m = (MovementComponent*)left->componentIDMap[movementComponentID]; if (m->moving) { left = nullptr; } }
-			}
+		chunk->dirty = false;
+		dirtyChunks.push_back({ chunk, &staticMeshes[VoxelGrid::ChunkKey(chunk->cx, chunk->cy, chunk->cz)] });
+	}
 
-			Entity* back = nullptr;
-			if (cube->z + 1 < ECS::main.maxDepth)
-			{
-				back = ECS::main.cubes[cube->x + 0][cube->y + 0][cube->z + 1];
-				if (back != nullptr) { MovementComponent* m = (MovementComponent*)back->componentIDMap[movementComponentID]; if (m->moving) { back = nullptr; } }
-			}
+	ThreadPool::main.ParallelFor((int)dirtyChunks.size(), 1, [&](int chunk, int, int)
+	{
+		BuildChunkMeshes(*dirtyChunks[chunk].first, *dirtyChunks[chunk].second);
+	});
+
+	renderBuffers.resize(query.ChunkCount(activeScene, chunkSize));
+
+	query.ParallelForEach(activeScene, chunkSize, [&](int chunk, CubeComponent* cube, PositionComponent* pos, MovementComponent* mover)
+	{
+		// Cubes resting in the grid are already in their chunk's mesh. The rest are mid-roll
+		// between cells, so they are drawn from scratch with none of their faces hidden.
+		if (cube->active && (mover->moving || grid.Get(cube->x, cube->y, cube->z) != cube->entity->GetHandle()))
+		{
+			renderBuffers[chunk].PrepareCube(cube->size, pos->position, pos->quaternion, cube->color, cube->texture->ID);
+		}
+	});
+}
+
+void CubeSystem::BuildChunkMeshes(const VoxelGrid::Chunk& chunk, std::unordered_map<int, StaticMesh>& meshes)
+{
+	static const int n = VoxelGrid::chunkSize;
+
+	// Give every distinct look in the chunk a number, and tag each exposed face of each resting cube with its look,
+	// in a set of tags for the cube's scene.
+	std::vector<CubeFace> looks;
+	std::vector<int> scenes;
+	std::vector<std::vector<int16_t>> tags;
+
+	for (int r = 0; r < VoxelGrid::chunkRows; r++)
+	{
+		uint16_t resting = chunk.occupied[r] & ~chunk.moving[r];
+		if (resting == 0) continue;
+
+		int ly = r & VoxelGrid::chunkMask;
+		int lz = r >> VoxelGrid::chunkBits;
+
+		for (int lx = 0; lx < n; lx++)
+		{
+			if (((resting >> lx) & 1) == 0) continue;
 
-			Entity* front = nullptr;
-			if (cube->z - 1 > 0)
+			int cell = VoxelGrid::CellIndex(lx, ly, lz);
+
+			Entity* e = ECS::main.GetEntity(chunk.cells[cell]);
+			if (e == nullptr) continue;
+
+			CubeComponent* cube = e->Get<CubeComponent>();
+			PositionComponent* pos = e->Get<PositionComponent>();
+			if (cube == nullptr || pos == nullptr || !cube->active || cube->exposedFaces == 0) continue;
+
+			int scene = (int)(std::find(scenes.begin(), scenes.end(), e->GetScene()) - scenes.begin());
+			if (scene == scenes.size())
 			{
-				front = ECS::main.cubes[cube->x + 0][cube->y + 0][cube->z - 1];
-				if (front != nullptr) { MovementComponent* m = (MovementComponent*)front->componentIDMap[movementComponentID]; if (m->moving) { front = nullptr; } }
+				scenes.push_back(e->GetScene());
+				tags.emplace_back(VoxelGrid::faceCount * VoxelGrid::chunkVolume, -1);
 			}
 
-			if (up == nullptr || down == nullptr || right == nullptr || left == nullptr || back == nullptr || front == nullptr)
+			CubeFace faces[VoxelGrid::faceCount];
+			RenderBuffer::CubeFaces(cube->size, pos->quaternion, cube->color, cube->texture->ID, faces);
+
+			for (int f = 0; f < VoxelGrid::faceCount; f++)
 			{
-				Game::main.renderer->PrepareCube(cube->size, pos->position, pos->quaternion, cube->color, cube->texture->ID);
+				if (((cube->exposedFaces >> f) & 1) == 0) continue;
+
+				int look = (int)(std::find(looks.begin(), looks.end(), faces[f]) - looks.begin());
+				if (look == looks.size()) looks.push_back(faces[f]);
+
+				tags[scene][f * VoxelGrid::chunkVolume + cell] = (int16_t)look;
 			}
 		}
 	}
-}
 
-void CubeSystem::AddComponent(Component* component)
-{
-	cubes.push_back((CubeComponent*)component);
+	// Scenes that had cubes here before and have none now keep their meshes, blanked.
+	for (auto& entry : meshes)
+	{
+		if (entry.second.ranges.size() > 0 && std::find(scenes.begin(), scenes.end(), entry.first) == scenes.end())
+		{
+			entry.second.Begin();
+			entry.second.End();
+		}
+	}
+
+	for (int i = 0; i < scenes.size(); i++)
+	{
+		MergeFaces(chunk, looks, tags[i], meshes[scenes[i]]);
+	}
 }
 
-void CubeSystem::PurgeEntity(Entity* e)
+void CubeSystem::MergeFaces(const VoxelGrid::Chunk& chunk, const std::vector<CubeFace>& looks, const std::vector<int16_t>& tags, StaticMesh& mesh)
 {
-	for (int i = 0; i < cubes.size(); i++)
+	static const int n = VoxelGrid::chunkSize;
+
+	glm::vec3 origin = ECS::main.CubeToWorldSpace(chunk.cx * n, chunk.cy * n, chunk.cz * n);
+	glm::vec3 step = ECS::main.CubeToWorldSpace(1, 1, 1) - ECS::main.CubeToWorldSpace(0, 0, 0);	// One cell along each axis, in world space.
+
+	mesh.Begin();
+
+	for (int f = 0; f < VoxelGrid::faceCount; f++)
 	{
-		if (cubes[i]->entity == e)
+		// The face lies in the other two axes, lower one first, the same way round as CubeFace expects.
+		int axis = VoxelGrid::faceAxes[f];
+		int a = axis == 0 ? 1 : 0;
+		int b = axis == 2 ? 1 : 2;
+
+		float outward = VoxelGrid::faceDirections[f][axis] * step[axis] > 0.0f ? 1.0f : -1.0f;
+
+		for (int slice = 0; slice < n; slice++)
 		{
-			CubeComponent* s = cubes[i];
-			cubes.erase(std::remove(cubes.begin(), cubes.end(), s), cubes.end());
-			delete s;
+			bool merged[n][n] = {};
+
+			auto lookAt = [&](int i, int j) -> int
+			{
+				if (merged[j][i]) return -1;
+
+				int c[3];
+				c[axis] = slice;
+				c[a] = i;
+				c[b] = j;
+
+				return tags[f * VoxelGrid::chunkVolume + VoxelGrid::CellIndex(c[0], c[1], c[2])];
+			};
+
+			for (int j = 0; j < n; j++)
+			{
+				for (int i = 0; i < n; i++)
+				{
+					int look = lookAt(i, j);
+					if (look < 0) continue;
+
+					// Grow along a as far as the look holds, then along b for as long as whole rows match.
+					int w = 1;
+					while (i + w < n && lookAt(i + w, j) == look) w++;
+
+					int h = 1;
+					while (j + h < n)
+					{
+						int k = 0;
+						while (k < w && lookAt(i + k, j + h) == look) k++;
+
+						if (k < w) break;
+						h++;
+					}
+
+					for (int dj = 0; dj < h; dj++)
+					{
+						for (int di = 0; di < w; di++)
+						{
+							merged[j + dj][i + di] = true;
+						}
+					}
+
+					const CubeFace& face = looks[look];
+
+					int first[3], last[3];
+					first[axis] = last[axis] = slice;
+					first[a] = i;
+					first[b] = j;
+					last[a] = i + w - 1;
+					last[b] = j + h - 1;
+
+					glm::vec3 p0 = origin + glm::vec3(first[0], first[1], first[2]) * step;
+					glm::vec3 p1 = origin + glm::vec3(last[0], last[1], last[2]) * step;
+
+					glm::vec3 lo = glm::min(p0, p1) - face.size / 2.0f;
+					glm::vec3 hi = glm::max(p0, p1) + face.size / 2.0f;
+
+					glm::vec3 corner = lo;
+					corner[axis] = p0[axis] + outward * face.size[axis] / 2.0f;
+
+					glm::vec3 spanA = { 0.0f, 0.0f, 0.0f };
+					glm::vec3 spanB = { 0.0f, 0.0f, 0.0f };
+					spanA[a] = hi[a] - lo[a];
+					spanB[b] = hi[b] - lo[b];
+
+					mesh.AddFace(face, corner, spanA, spanB, w, h);
+				}
+			}
 		}
 	}
+
+	mesh.End();
 }
 
 #pragma endregion
 
 #pragma region Animation System
+
 void AnimationSystem::Update(int activeScene, float deltaTime)
 {
-	for (int i = 0; i < anims.size(); i++)
-	{
-		AnimationComponent* a = anims[i];
+	renderBuffers.resize(1);
 
-		if (a->active && a->entity->GetScene() == activeScene ||
-			a->active && a->entity->GetScene() == 0)
+	query.ForEach(activeScene, [&](AnimationComponent* a, PositionComponent* pos)
+	{
+		if (a->active)
 		{
 			a->lastTick += deltaTime;
 
@@ -1437,29 +1427,9 @@ void AnimationSystem::Update(int activeScene, float deltaTime)
 				}
 			}
 
-			PositionComponent* pos = (PositionComponent*)a->entity->componentIDMap[positionComponentID];
-			
-			Game::main.renderer->PrepareQuad(glm::vec2(activeAnimation->width * a->scaleX, activeAnimation->height * a->scaleY), pos->position, pos->quaternion, a->color, activeAnimation->ID, cellX, cellY, activeAnimation->columns, activeAnimation->rows, a->flippedX, a->flippedY);
-		}
-	}
-}
-
-void AnimationSystem::AddComponent(Component* component)
-{
-	anims.push_back((AnimationComponent*)component);
-}
-
-void AnimationSystem::PurgeEntity(Entity* e)
-{
-	for (int i = 0; i < anims.size(); i++)
-	{
-		if (anims[i]->entity == e)
-		{
-			AnimationComponent* s = anims[i];
-			anims.erase(std::remove(anims.begin(), anims.end(), s), anims.end());
-			delete s;
+			renderBuffers[0].PrepareQuad(glm::vec2(activeAnimation->width * a->scaleX, activeAnimation->height * a->scaleY), pos->position, pos->quaternion, a->color, activeAnimation->ID, cellX, cellY, activeAnimation->columns, activeAnimation->rows, a->flippedX, a->flippedY);
 		}
-	}
+	});
 }
 
 #pragma endregion
@@ -1468,37 +1438,16 @@ void AnimationSystem::PurgeEntity(Entity* e)
 
 void AnimationControllerSystem::Update(int activeScene, float deltaTime)
 {
-	for (int i = 0; i < controllers.size(); i++)
+	query.ForEach(activeScene, [&](AnimationControllerComponent* c)
 	{
-		AnimationControllerComponent* c = controllers[i];
-
-		if (c->active && c->entity->GetScene() == activeScene ||
-			c->active && c->entity->GetScene() == 0)
+		if (c->active)
 		{
 			if (c->subID == playerAnimControllerSubID)
 			{
 				// Baba booey.
 			}
 		}
-	}
-}
-
-void AnimationControllerSystem::AddComponent(Component* component)
-{
-	controllers.push_back((AnimationControllerComponent*)component);
-}
-
-void AnimationControllerSystem::PurgeEntity(Entity* e)
-{
-	for (int i = 0; i < controllers.size(); i++)
-	{
-		if (controllers[i]->entity == e)
-		{
-			AnimationControllerComponent* s = controllers[i];
-			controllers.erase(std::remove(controllers.begin(), controllers.end(), s), controllers.end());
-			delete s;
-		}
-	}
+	});
 }
 
 #pragma endregion
@@ -1507,14 +1456,11 @@ void AnimationControllerSystem::PurgeEntity(Entity* e)
 
 void CameraFollowSystem::Update(int activeScene, float deltaTime)
 {
-	for (int i = 0; i < cams.size(); i++)
+	query.ForEach(activeScene, [&](CameraFollowComponent* c, PositionComponent* pos)
 	{
-		CameraFollowComponent* c = cams[i];
-
 		if (c->track)
 		{
-			if (c->active && c->entity->GetScene() == activeScene ||
-				c->active && c->entity->GetScene() == 0)
+			if (c->active)
 			{
 				// We want the camera to move along a sphere around the followed object
 				// maintaining a constant distance from that object.
@@ -1525,7 +1471,6 @@ void CameraFollowSystem::Update(int activeScene, float deltaTime)
 				// Thus, what the camera follow component needs isn't an offset in space
 				// but a quaternion defining the desired rotation along that sphere.
 
-				PositionComponent* pos = (PositionComponent*)c->entity->componentIDMap[positionComponentID];
 				glm::vec3 position = pos->position;
 				Quaternion rotation = c->rotation;
 				float d = c->distance;
@@ -1537,25 +1482,7 @@ void CameraFollowSystem::Update(int activeScene, float deltaTime)
 				Game::main.cameraRotation = rotation;
 			}
 		}
-	}
-}
-
-void CameraFollowSystem::AddComponent(Component* component)
-{
-	cams.push_back((CameraFollowComponent*)component);
-}
-
-void CameraFollowSystem::PurgeEntity(Entity* e)
-{
-	for (int i = 0; i < cams.size(); i++)
-	{
-		if (cams[i]->entity == e)
-		{
-			CameraFollowComponent* s = cams[i];
-			cams.erase(std::remove(cams.begin(), cams.end(), s), cams.end());
-			delete s;
-		}
-	}
+	});
 }
 
 #pragma endregion
@@ -1564,15 +1491,10 @@ void CameraFollowSystem::PurgeEntity(Entity* e)
 
 void InputSystem::Update(int activeScene, float deltaTime)
 {
-	for (int i = 0; i < inputs.size(); i++)
+	query.ForEach(activeScene, [&](InputComponent* input, ActorComponent* actor, MovementComponent* mover)
 	{
-		InputComponent* input = inputs[i];
-
-		if (input->active && input->entity->GetScene() == activeScene ||
-			input->active && input->entity->GetScene() == 0)
+		if (input->active)
 		{
-			ActorComponent* actor = (ActorComponent*)input->entity->componentIDMap[actorComponentID];
-
 			// Testing
 			if (glfwGetKey(Game::main.window, GLFW_KEY_0) == GLFW_PRESS) actor->face = Face::front;
 			if (glfwGetKey(Game::main.window, GLFW_KEY_1) == GLFW_PRESS) actor->face = Face::back;
@@ -1582,9 +1504,8 @@ void InputSystem::Update(int activeScene, float deltaTime)
 			if (glfwGetKey(Game::main.window, GLFW_KEY_5) == GLFW_PRESS) actor->face = Face::bottom;
 
 			// Player Controlling
-			// ActorComponent* actor = (ActorComponent*)input->entity->componentIDMap[actorComponentID];
-			MovementComponent* mover = (MovementComponent*)input->entity->componentIDMap[movementComponentID];
-			MovementComponent* cube = (MovementComponent*)actor->cube->componentIDMap[movementComponentID];
+			// ActorComponent* actor = input->entity->Get<ActorComponent>();
+			MovementComponent* cube = ECS::main.GetEntity(actor->cube)->Get<MovementComponent>();
 
 			bool moveForward = ((glfwGetKey(Game::main.window, Game::main.moveForwardKey) == GLFW_PRESS) || (glfwGetMouseButton(Game::main.window, Game::main.moveForwardKey) == GLFW_PRESS));
 			bool moveBack = ((glfwGetKey(Game::main.window, Game::main.moveBackKey) == GLFW_PRESS) || (glfwGetMouseButton(Game::main.window, Game::main.moveBackKey) == GLFW_PRESS));
@@ -1647,7 +1568,7 @@ void InputSystem::Update(int activeScene, float deltaTime)
 
 			bool freeCam = ((glfwGetKey(Game::main.window, Game::main.freeCamKey) == GLFW_PRESS) || (glfwGetMouseButton(Game::main.window, Game::main.freeCamKey) == GLFW_PRESS));
 
-			CameraFollowComponent* camFollower = (CameraFollowComponent*)ECS::main.player->componentIDMap[cameraFollowComponentID];
+			CameraFollowComponent* camFollower = ECS::main.GetEntity(ECS::main.player)->Get<CameraFollowComponent>();
 
 			bool rotX = ((glfwGetKey(Game::main.window, Game::main.rotateXKey) == GLFW_PRESS) || (glfwGetMouseButton(Game::main.window, Game::main.rotateXKey) == GLFW_PRESS));
 			bool unrotX = ((glfwGetKey(Game::main.window, Game::main.unrotateXKey) == GLFW_PRESS) || (glfwGetMouseButton(Game::main.window, Game::main.unrotateXKey) == GLFW_PRESS));
@@ -1787,25 +1708,7 @@ void InputSystem::Update(int activeScene, float deltaTime)
 				camFollower->track = true;
 			}
 		}
-	}
-}
-
-void InputSystem::AddComponent(Component* component)
-{
-	inputs.push_back((InputComponent*)component);
-}
-
-void InputSystem::PurgeEntity(Entity* e)
-{
-	for (int i = 0; i < inputs.size(); i++)
-	{
-		if (inputs[i]->entity == e)
-		{
-			InputComponent* s = inputs[i];
-			inputs.erase(std::remove(inputs.begin(), inputs.end(), s), inputs.end());
-			delete s;
-		}
-	}
+	});
 }
 
 #pragma endregion
@@ -1814,35 +1717,13 @@ void InputSystem::PurgeEntity(Entity* e)
 
 void BillboardingSystem::Update(int activeScene, float deltaTime)
 {
-	for (int i = 0; i < boards.size(); i++)
+	query.ForEach(activeScene, [&](BillboardingComponent* board, PositionComponent* pos)
 	{
-		BillboardingComponent* board = boards[i];
-
-		if (board->active && board->entity->GetScene() == activeScene ||
-			board->active && board->entity->GetScene() == 0)
+		if (board->active)
 		{
-			PositionComponent* pos = (PositionComponent*)board->entity->componentIDMap[positionComponentID];
 			pos->quaternion = Util::Slerp(pos->quaternion, Game::main.cameraRotation, 20.0f * deltaTime);
 		}
-	}
-}
-
-void BillboardingSystem::AddComponent(Component* component)
-{
-	boards.push_back((BillboardingComponent*)component);
-}
-
-void BillboardingSystem::PurgeEntity(Entity* e)
-{
-	for (int i = 0; i < boards.size(); i++)
-	{
-		if (boards[i]->entity == e)
-		{
-			BillboardingComponent* s = boards[i];
-			boards.erase(std::remove(boards.begin(), boards.end(), s), boards.end());
-			delete s;
-		}
-	}
+	});
 }
 
 #pragma endregion
@@ -1851,38 +1732,17 @@ void BillboardingSystem::PurgeEntity(Entity* e)
 
 void TurnSystem::Update(int activeScene, float deltaTime)
 {
-	for (int i = 0; i < actors.size(); i++)
+	query.ForEach(activeScene, [&](ActorComponent* actor)
 	{
-		ActorComponent* actor = actors[i];
-
-		if (actor->active && actor->entity->GetScene() == activeScene ||
-			actor->active && actor->entity->GetScene() == 0)
+		if (actor->active)
 		{
-			/*PositionComponent* pos = (PositionComponent*)actor->entity->componentIDMap[positionComponentID];
-			AnimationComponent* anim = (AnimationComponent*)actor->entity->componentIDMap[animationComponentID];
+			/*PositionComponent* pos = actor->entity->Get<PositionComponent>();
+			AnimationComponent* anim = actor->entity->Get<AnimationComponent>();
 			Quaternion r = Util::GetQuaternionFromFace(actor->face);
 			anim->offset = Util::Rotate(anim->baseOffset, r);*/
 			// pos->quaternion = r;
 		}
-	}
-}
-
-void TurnSystem::AddComponent(Component* component)
-{
-	actors.push_back((ActorComponent*)component);
-}
-
-void TurnSystem::PurgeEntity(Entity* e)
-{
-	for (int i = 0; i < actors.size(); i++)
-	{
-		if (actors[i]->entity == e)
-		{
-			ActorComponent* s = actors[i];
-			actors.erase(std::remove(actors.begin(), actors.end(), s), actors.end());
-			delete s;
-		}
-	}
+	});
 }
 
 #pragma endregion
@@ -1891,12 +1751,12 @@ void TurnSystem::PurgeEntity(Entity* e)
 
 void MovementSystem::Update(int activeScene, float deltaTime)
 {
-	for (int i = 0; i < movers.size(); i++)
-	{
-		MovementComponent* move = movers[i];
+	stopped.resize(query.ChunkCount(activeScene, chunkSize));
 
-		if (move->active && move->entity->GetScene() == activeScene ||
-			move->active && move->entity->GetScene() == 0)
+	// Each mover only touches its own queue and position, so chunks can run on any thread.
+	query.ParallelForEach(activeScene, chunkSize, [&](int chunk, MovementComponent* move, PositionComponent* pos)
+	{
+		if (move->active)
 		{
 			std::vector<Movement*> finishedMoves;
 
@@ -1906,8 +1766,6 @@ void MovementSystem::Update(int activeScene, float deltaTime)
 
 				if (m->movementType == MovementType::linear)
 				{
-					PositionComponent* pos = (PositionComponent*)move->entity->componentIDMap[positionComponentID];
-
 					LinearMovement* line = (LinearMovement*)m;
 
 					glm::vec3 nextStep = Util::Lerp(pos->position, line->target, deltaTime * line->speed);
@@ -1923,8 +1781,6 @@ void MovementSystem::Update(int activeScene, float deltaTime)
 				}
 				else if (m->movementType == MovementType::bezier)
 				{
-					PositionComponent* pos = (PositionComponent*)move->entity->componentIDMap[positionComponentID];
-
 					BezierMovement* curving = (BezierMovement*)m;
 
 					curving->t += deltaTime * curving->speed;
@@ -1938,8 +1794,6 @@ void MovementSystem::Update(int activeScene, float deltaTime)
 				}
 				else if (m->movementType == MovementType::rotation)
 				{
-					PositionComponent* pos = (PositionComponent*)move->entity->componentIDMap[positionComponentID];
-
 					RotatingMovement* rotation = (RotatingMovement*)m;
 
 					Quaternion slerp = Util::Slerp(pos->quaternion, rotation->targetRotation, deltaTime * rotation->speed);
@@ -1954,8 +1808,6 @@ void MovementSystem::Update(int activeScene, float deltaTime)
 				}
 				else if (m->movementType == MovementType::bezierRotation)
 				{
-					PositionComponent* pos = (PositionComponent*)move->entity->componentIDMap[positionComponentID];
-
 					BezierRotatingMovement* curving = (BezierRotatingMovement*)m;
 
 					curving->t += deltaTime * curving->speed;
@@ -1972,33 +1824,29 @@ void MovementSystem::Update(int activeScene, float deltaTime)
 			for (int j = 0; j < finishedMoves.size(); j++)
 			{
 				move->queue.erase(std::remove(move->queue.begin(), move->queue.end(), finishedMoves[j]), move->queue.end());
+				delete finishedMoves[j];
 			}
 
 			finishedMoves.clear();
 
-			if (move->queue.size() == 0)
+			if (move->queue.size() == 0 && move->moving)
 			{
 				move->moving = false;
+				stopped[chunk].push_back(move);
 			}
 		}
-	}
-}
-
-void MovementSystem::AddComponent(Component* component)
-{
-	movers.push_back((MovementComponent*)component);
-}
+	});
 
-void MovementSystem::PurgeEntity(Entity* e)
-{
-	for (int i = 0; i < movers.size(); i++)
+	// Neighbouring cubes share words in the grid's moving bitset, so those bits are cleared here,
+	// once the chunks have joined, rather than from inside them.
+	for (int c = 0; c < stopped.size(); c++)
 	{
-		if (movers[i]->entity == e)
+		for (int i = 0; i < stopped[c].size(); i++)
 		{
-			MovementComponent* s = movers[i];
-			movers.erase(std::remove(movers.begin(), movers.end(), s), movers.end());
-			delete s;
+			stopped[c][i]->SetMoving(false);
 		}
+
+		stopped[c].clear();
 	}
 }
 
@@ -2008,37 +1856,17 @@ void MovementSystem::PurgeEntity(Entity* e)
 
 void ModelSystem::Update(int activeScene, float deltaTime)
 {
-	for (int i = 0; i < models.size(); i++)
-	{
-		ModelComponent* model = models[i];
+	renderBuffers.resize(1);
 
-		if (model->active && model->entity->GetScene() == activeScene ||
-			model->active && model->entity->GetScene() == 0)
+	query.ForEach(activeScene, [&](ModelComponent* model, PositionComponent* pos)
+	{
+		if (model->active)
 		{
-			PositionComponent* pos = (PositionComponent*)model->entity->componentIDMap[positionComponentID];
 			glm::vec3 offset = Util::Rotate(model->offset, pos->quaternion);
 
-			Game::main.renderer->PrepareModel(model->scale, pos->position + offset, pos->quaternion, model->color, model->model);
-		}
-	}
-}
-
-void ModelSystem::AddComponent(Component* component)
-{
-	models.push_back((ModelComponent*)component);
-}
-
-void ModelSystem::PurgeEntity(Entity* e)
-{
-	for (int i = 0; i < models.size(); i++)
-	{
-		if (models[i]->entity == e)
-		{
-			ModelComponent* s = models[i];
-			models.erase(std::remove(models.begin(), models.end(), s), models.end());
-			delete s;
+			renderBuffers[0].PrepareModel(model->scale, pos->position + offset, pos->quaternion, model->color, model->model);
 		}
-	}
+	});
 }
 
 #pragma endregion
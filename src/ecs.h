@@ -5,88 +5,129 @@
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <tuple>
 #include <map>
+#include <unordered_map>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
 
-class Entity;
-class System;
-class Component;
-
-class ActorComponent;
-class CubeComponent;
-enum class Face;
-
-class ComponentBlock
-{
-public:
-	System* system;
-	int componentID;
-
-	void Update(int activeScene, float deltaTime);
-	void AddComponent(Component* c);
-	void PurgeEntity(Entity* e);
-	ComponentBlock(System* system, int componentID);
-};
+#include "entity.h"
+#include "system.h"
+#include "command.h"
+#include "puzzlesim.h"
 
 class ECS
 {
 private:
-	uint32_t entityIDCounter = 0;
 	uint32_t otherIDCounter = 0;
 	int round = 0;
 
 public:
+	template <typename... Ts>
+	using Query = ::Query<Ts...>;
+
 	static ECS main;
 	int activeScene = 0;
 
-	static const int cubeSize = 10;
-
-	static const int maxWidth = 100;
-	static const int maxHeight = 100;
-	static const int maxDepth = 100;
-
-	Entity* player;
-	Entity* cubes[maxWidth][maxHeight][maxDepth];
-
-	std::vector<Entity*> entities;
-	std::vector<Entity*> dyingEntities;
+	static const int cubeSize = PuzzleSim::cubeSize;
+
+	EntityHandle player;
+
+	// The puzzle itself, grid included. Input goes in through MoveActor and RollCube,
+	// and what comes out is animated by OnMove.
+	PuzzleSim sim;
+
+	// The entity table. Slots are recycled through freeSlots and the deque never moves
+	// a record once it is placed, so components can keep plain Entity pointers.
+	std::deque<Entity> entities;
+	std::vector<uint32_t> freeSlots;
+
+	// Structural changes made while systems run; applied at the end of Update.
+	CommandBuffer commands;
+
+	// Every system, held by value and updated in this order.
+	std::tuple<
+		InputSystem,
+		MovementSystem,
+		CubeSystem,
+		ModelSystem,
+		AnimationControllerSystem,
+		AnimationSystem,
+		BillboardingSystem,
+		CameraFollowSystem,
+		TurnSystem> systems;
+
+	template <typename F>
+	void ForEachSystem(F&& f)
+	{
+		std::apply([&](auto&... system) { (f(system), ...); }, systems);
+	}
+
+	// A system as the scheduler sees it: its update plus its edges in the frame's dependency graph.
+	struct ScheduledSystem
+	{
+		std::function<void(int, float)> update;
+		uint32_t reads = 0;
+		uint32_t writes = 0;
+		bool mainThread = false;
+
+		std::vector<int> dependents;	// Systems that can't start until this one finishes.
+		int dependencies = 0;			// How many systems this one waits on.
+	};
+
+	std::vector<ScheduledSystem> schedule;
+	std::unique_ptr<std::atomic<int>[]> waitingOn;
+	std::atomic<int> systemsLeft{ 0 };
+
+	std::mutex mainThreadMutex;
+	std::vector<int> mainThreadReady;
 
-	std::vector<ComponentBlock*> componentBlocks;
-
-	uint32_t GetID();
 	uint32_t GetOtherID();
 	void Init();
 	void Update(float deltaTime);
 
-	Entity* CreateEntity(int scene, std::string name);
+	void BuildSchedule();
+	void RunSystems(float deltaTime);
+	void DispatchSystem(int index, float deltaTime);
+	void RunSystem(int index, float deltaTime);
+	void SubmitRenderBuffers();
+
+	Entity* CreateEntity(int scene, const std::string& name);	// Aborts once every index a handle can hold is taken.
+	Entity* GetEntity(EntityHandle handle);
 	void DeleteEntity(Entity* e);
+	void DeleteEntities(const std::vector<Entity*>& es);
+	void DeleteScene(int scene);
+	void ChangeScene(Entity* e, int scene);
 	void AddDeadEntity(Entity* e);
-	void PurgeDeadEntities();
 
-	void RegisterComponent(Component* component, Entity* entity);
+	bool RegisterComponent(Component* component, Entity* entity);	// False, and nothing done, if the entity already has one of its type.
+	void RemoveComponent(Entity* entity, int componentID);
 
 	glm::vec3 CubeToWorldSpace(int x, int y, int z);
 	glm::vec3 WorldToCubeSpace(glm::vec3 position);
 
 	Entity* GetCube(int x, int y, int z);
+
+	// Catches a cube's component up with the cell the sim has moved it to.
 	void MoveCube(CubeComponent* cube, int x, int y, int z);
+
+	// Recomputes the face masks of the cube in a cell and of its six neighbours.
+	void RefreshFaces(int x, int y, int z);
+	void RefreshAllFaces();
 	void PositionCube(CubeComponent* cube, int x, int y, int z);
 	void PositionActor(ActorComponent* actor);
 
-	void MoveActor(ActorComponent* actor, int dX, int dY, int dZ);
-
-	// bool CheckAutofrendation(CubeComponent* activeCube, Face activeFace, Face rollDirection); // Self-Crushing
-
-	void FloodFill(std::vector<CubeComponent*>& inside, CubeComponent* cube, CubeComponent* activeCube, CubeComponent* fulcrum);
-	std::vector<CubeComponent*> DetermineStructure(CubeComponent* cube, CubeComponent* fulcrum, Face direction);
-
-	std::pair<Face, bool> FindFulcrum(CubeComponent* activeCube, Face activeFace, Face rollDirection);
-	Face DetermineRollDirection(Face fulcrum, Face activeFace, Face rollDirection);
-
-	void QuarterRoll(ActorComponent* actor, Face standingFace, Face rollDirection, Entity* landingTarget, Face landingFace, std::vector<CubeComponent*> affectedCubes);
-	void HalfRoll(ActorComponent* actor, Face standingFace, Face oppFulcrum, Face rollDirection, Entity* landingTarget, Face landingFace, std::vector<CubeComponent*> affectedCubes);
+	SimActor GetSimActor(ActorComponent* actor);
 
+	// The grid plus where the actor stands, from the hash the sim keeps as cubes move.
+	uint64_t StateHash(ActorComponent* actor);
+	void MoveActor(ActorComponent* actor, int dX, int dY, int dZ);
 	void RollCube(ActorComponent* actor, Face rollDirection);
 
+	void OnMove(const MoveEvent& move);
 	void RollActor(ActorComponent* actor, Face rollDirection, Face landingFace, Face standingFace, bool half);
 };
 
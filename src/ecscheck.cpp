@@ -0,0 +1,89 @@
+// ecscheck.cpp
+//
+// Checks that CommandBuffer::Playback leaves entities the way the commands, in the order they were
+// recorded, say it should. Needs no window; nothing here touches GL.
+
+#include <iostream>
+
+#include "game.h"
+#include "ecs.h"
+
+Game Game::main;
+ECS ECS::main;
+NameTable NameTable::main;
+
+static int failures = 0;
+
+static void Expect(bool ok, const char* what)
+{
+	std::cout << (ok ? "ok     " : "FAILED ") << what << '\n';
+	if (!ok) failures++;
+}
+
+static PositionComponent* NewPosition(Entity* e, float x)
+{
+	return new PositionComponent(e, true, glm::vec3(x, 0.0f, 0.0f), { 1, 0, 0, 0 });
+}
+
+int main(void)
+{
+	ECS& ecs = ECS::main;
+
+	// Removed and then added again in the same frame: the new component should be the one left.
+	{
+		Entity* e = ecs.CreateEntity(0, "Replaced");
+		ecs.RegisterComponent(NewPosition(e, 1.0f), e);
+
+		ecs.commands.RemoveComponent(e->GetHandle(), positionComponentID);
+		ecs.commands.AddComponent(e->GetHandle(), NewPosition(e, 2.0f));
+		ecs.commands.Playback(ecs);
+
+		PositionComponent* position = e->Get<PositionComponent>();
+		Expect(position != nullptr && position->position.x == 2.0f, "remove then add keeps the new component");
+		Expect((e->signature & (1u << positionComponentID)) != 0, "remove then add keeps the signature bit");
+	}
+
+	// The other way round, the entity should end up with neither.
+	{
+		Entity* e = ecs.CreateEntity(0, "Removed");
+
+		ecs.commands.AddComponent(e->GetHandle(), NewPosition(e, 3.0f));
+		ecs.commands.RemoveComponent(e->GetHandle(), positionComponentID);
+		ecs.commands.Playback(ecs);
+
+		Expect(e->Get<PositionComponent>() == nullptr && e->signature == 0, "add then remove leaves nothing");
+	}
+
+	// Two adds of one type: the first one recorded stays, and the second is turned away (and freed).
+	{
+		Entity* e = ecs.CreateEntity(0, "Doubled");
+
+		ecs.commands.AddComponent(e->GetHandle(), NewPosition(e, 4.0f));
+		ecs.commands.AddComponent(e->GetHandle(), NewPosition(e, 5.0f));
+		ecs.commands.Playback(ecs);
+
+		PositionComponent* position = e->Get<PositionComponent>();
+		Expect(position != nullptr && position->position.x == 4.0f && e->components.size() == 1, "a second add of a type is dropped");
+	}
+
+	// Commands for an entity created in the same frame, recorded before and after another entity's.
+	{
+		Entity* other = ecs.CreateEntity(0, "Other");
+		ecs.RegisterComponent(NewPosition(other, 6.0f), other);
+
+		EntityHandle pending = ecs.commands.CreateEntity(0, "Pending");
+		ecs.commands.AddComponent(pending, NewPosition(nullptr, 7.0f));
+		ecs.commands.RemoveComponent(other->GetHandle(), positionComponentID);
+		ecs.commands.RemoveComponent(pending, positionComponentID);
+		ecs.commands.AddComponent(pending, NewPosition(nullptr, 8.0f));
+		ecs.commands.Playback(ecs);
+
+		Entity* created = &ecs.entities.back();
+		PositionComponent* position = created->Get<PositionComponent>();
+
+		Expect(position != nullptr && position->position.x == 8.0f && position->entity == created, "a new entity's commands run in order");
+		Expect(other->Get<PositionComponent>() == nullptr, "another entity's commands still run");
+	}
+
+	return failures == 0 ? 0 : 1;
+}
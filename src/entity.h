@@ -1,31 +1,99 @@
 #ifndef ENTITY_H
 #define ENTITY_H
 
+#include <string>
 #include <vector>
+#include <deque>
 #include <unordered_map>
+#include <cstdint>
+
+// Entity names are a debugging aid. Release builds drop them unless asked otherwise,
+// and then an entity carries no name at all.
+#ifndef ENTITY_NAMES
+#ifdef NDEBUG
+#define ENTITY_NAMES 0
+#else
+#define ENTITY_NAMES 1
+#endif
+#endif
 
 class Component;
 
+template <typename T>
+struct ComponentTypeId;
+
+static const int maxComponentTypes = 16;
+
+// A 32-bit reference into the ECS entity table.
+// The low bits index the table and the high bits hold the generation the slot
+// had when the handle was made, so a handle that outlives its entity can be caught.
+struct EntityHandle
+{
+	static const uint32_t indexBits = 22;
+	static const uint32_t indexMask = (1u << indexBits) - 1;
+	static const uint32_t maxGeneration = (1u << (32 - indexBits)) - 1;
+
+	uint32_t value = 0;		// Generation 0 is never handed out, so 0 is the null handle.
+
+	uint32_t Index() const { return value & indexMask; }
+	uint32_t Generation() const { return value >> indexBits; }
+	bool IsNull() const { return value == 0; }
+
+	bool operator==(const EntityHandle& rhs) const noexcept { return value == rhs.value; }
+	bool operator!=(const EntityHandle& rhs) const noexcept { return value != rhs.value; }
+
+	static EntityHandle Make(uint32_t index, uint32_t generation)
+	{
+		return { (generation << indexBits) | (index & indexMask) };
+	}
+};
+
+// Every distinct entity name is stored once here, and entities keep its index.
+// A level full of cubes all named "Cube" shares a single string.
+// Names are only interned when entities are created, which happens on the main thread.
+class NameTable
+{
+public:
+	static NameTable main;
+
+	uint32_t Intern(const std::string& name);
+	const std::string& Get(uint32_t id);
+
+private:
+	std::unordered_map<std::string, uint32_t> ids;
+	std::deque<std::string> names;	// Indexed by ID. A deque, so references handed out by Get stay valid.
+};
+
 class Entity
 {
 private:
-	int ID;
+	EntityHandle handle;
 	int scene;
-	std::string name;
+#if ENTITY_NAMES
+	uint32_t nameID;
+#endif
 
 public:
-	std::unordered_map<int, Component*> componentIDMap;
+	uint32_t signature;										// One bit per component ID; the entity's archetype.
+	Component* componentIDMap[maxComponentTypes];			// Indexed directly by component ID.
 	std::vector<Component*> components;
 
+	template <typename T>
+	T* Get()
+	{
+		return static_cast<T*>(componentIDMap[ComponentTypeId<T>::value]);
+	}
+
 	int				GetID();
+	EntityHandle	GetHandle();
 	int				GetScene();
-	std::string		GetName();
+	const std::string&	GetName();
 
-	void			SetID(int ID);
-	void			SetScene(int scene);
-	void			SetName(std::string name);
+	void			SetHandle(EntityHandle handle);
+	void			SetScene(int scene);	// Queries partition by scene; live entities move with ECS::ChangeScene.
+	void			SetName(const std::string& name);
 
-	Entity(int ID, int scene, std::string name);
+	Entity(EntityHandle handle, int scene, const std::string& name);
 };
 
 #endif
\ No newline at end of file
@@ -1,6 +1,5 @@
 #include "game.h"
 #include <glm/gtc/matrix_transform.hpp>
-#include <corecrt_math_defines.h>
 
 void Game::UpdateProjection()
 {
@@ -0,0 +1,283 @@
+#include "grid.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GRID_SSE2 1
+#include <emmintrin.h>
+#else
+#define GRID_SSE2 0
+#endif
+
+EntityHandle VoxelGrid::Get(int x, int y, int z) const
+{
+	Chunk* chunk = FindChunk(ChunkCoord(x), ChunkCoord(y), ChunkCoord(z));
+	if (chunk == nullptr) return EntityHandle();
+
+	return chunk->cells[CellIndex(LocalCoord(x), LocalCoord(y), LocalCoord(z))];
+}
+
+void VoxelGrid::Set(int x, int y, int z, EntityHandle entity)
+{
+	if (entity.IsNull())
+	{
+		Clear(x, y, z);
+		return;
+	}
+
+	int cx = ChunkCoord(x), cy = ChunkCoord(y), cz = ChunkCoord(z);
+	std::unique_ptr<Chunk>& chunk = chunks[ChunkKey(cx, cy, cz)];
+
+	if (chunk == nullptr)
+	{
+		chunk = std::make_unique<Chunk>();
+		chunk->cx = cx;
+		chunk->cy = cy;
+		chunk->cz = cz;
+	}
+
+	int lx = LocalCoord(x), ly = LocalCoord(y), lz = LocalCoord(z);
+
+	EntityHandle& cell = chunk->cells[CellIndex(lx, ly, lz)];
+	if (cell.IsNull()) chunk->count++;
+
+	cell = entity;
+	chunk->occupied[RowIndex(ly, lz)] |= (uint16_t)(1u << lx);
+
+	MarkDirty(x, y, z);
+}
+
+void VoxelGrid::Clear(int x, int y, int z)
+{
+	auto result = chunks.find(ChunkKey(ChunkCoord(x), ChunkCoord(y), ChunkCoord(z)));
+	if (result == chunks.end()) return;
+
+	Chunk* chunk = result->second.get();
+	int lx = LocalCoord(x), ly = LocalCoord(y), lz = LocalCoord(z);
+
+	EntityHandle& cell = chunk->cells[CellIndex(lx, ly, lz)];
+
+	if (cell.IsNull()) return;
+
+	cell = EntityHandle();
+	chunk->count--;
+
+	uint16_t bit = (uint16_t)(1u << lx);
+	chunk->occupied[RowIndex(ly, lz)] &= ~bit;
+	chunk->moving[RowIndex(ly, lz)] &= ~bit;
+
+	if (chunk->count == 0)
+	{
+		if (trackFreed) freedChunks.push_back(result->first);
+		chunks.erase(result);
+	}
+
+	MarkDirty(x, y, z);
+}
+
+void VoxelGrid::SetMoving(int x, int y, int z, bool moving)
+{
+	Chunk* chunk = FindChunk(ChunkCoord(x), ChunkCoord(y), ChunkCoord(z));
+	if (chunk == nullptr) return;
+
+	int lx = LocalCoord(x);
+	uint16_t& row = chunk->moving[RowIndex(LocalCoord(y), LocalCoord(z))];
+
+	if (moving) row |= (uint16_t)(1u << lx);
+	else row &= (uint16_t)~(1u << lx);
+
+	MarkDirty(x, y, z);
+}
+
+void VoxelGrid::MarkDirty(int x, int y, int z)
+{
+	Chunk* chunk = FindChunk(ChunkCoord(x), ChunkCoord(y), ChunkCoord(z));
+	if (chunk != nullptr) chunk->dirty = true;
+
+	for (int f = 0; f < faceCount; f++)
+	{
+		chunk = FindChunk(ChunkCoord(x + faceDirections[f][0]), ChunkCoord(y + faceDirections[f][1]), ChunkCoord(z + faceDirections[f][2]));
+		if (chunk != nullptr) chunk->dirty = true;
+	}
+}
+
+bool VoxelGrid::IsSolid(int x, int y, int z) const
+{
+	Chunk* chunk = FindChunk(ChunkCoord(x), ChunkCoord(y), ChunkCoord(z));
+	if (chunk == nullptr) return false;
+
+	int r = RowIndex(LocalCoord(y), LocalCoord(z));
+	return (((chunk->occupied[r] & ~chunk->moving[r]) >> LocalCoord(x)) & 1) != 0;
+}
+
+uint8_t VoxelGrid::ExposedFaces(int x, int y, int z) const
+{
+	uint8_t faces = 0;
+
+	for (int f = 0; f < faceCount; f++)
+	{
+		if (!IsSolid(x + faceDirections[f][0], y + faceDirections[f][1], z + faceDirections[f][2]))
+		{
+			faces |= (uint8_t)(1 << f);
+		}
+	}
+
+	return faces;
+}
+
+void VoxelGrid::GetNeighbourhood(int x, int y, int z, EntityHandle out[1 + faceCount]) const
+{
+	Chunk* chunk = FindChunk(ChunkCoord(x), ChunkCoord(y), ChunkCoord(z));
+
+	int local[3] = { LocalCoord(x), LocalCoord(y), LocalCoord(z) };
+	int cell = CellIndex(local[0], local[1], local[2]);
+
+	out[0] = chunk != nullptr ? chunk->cells[cell] : EntityHandle();
+
+	for (int f = 0; f < faceCount; f++)
+	{
+		int axis = faceAxes[f];
+		int delta = faceDirections[f][axis];
+		int l = local[axis] + delta;
+
+		if (chunk != nullptr && l >= 0 && l < chunkSize)
+		{
+			out[1 + f] = chunk->cells[CellStep(cell, axis, delta)];
+		}
+		else
+		{
+			out[1 + f] = Get(x + faceDirections[f][0], y + faceDirections[f][1], z + faceDirections[f][2]);
+		}
+	}
+}
+
+VoxelGrid::Chunk* VoxelGrid::FindChunk(int cx, int cy, int cz) const
+{
+	auto result = chunks.find(ChunkKey(cx, cy, cz));
+	if (result == chunks.end()) return nullptr;
+
+	return result->second.get();
+}
+
+VoxelGrid::Chunk* VoxelGrid::FindChunk(uint64_t key) const
+{
+	auto result = chunks.find(key);
+	if (result == chunks.end()) return nullptr;
+
+	return result->second.get();
+}
+
+int VoxelGrid::ChunkCount() const
+{
+	return (int)chunks.size();
+}
+
+void VoxelGrid::CollectChunks(std::vector<Chunk*>& out) const
+{
+	out.clear();
+
+	for (auto& entry : chunks)
+	{
+		out.push_back(entry.second.get());
+	}
+}
+
+void VoxelGrid::TakeFreedChunks(std::vector<uint64_t>& out)
+{
+	trackFreed = true;
+
+	out.clear();
+	out.swap(freedChunks);
+}
+
+void VoxelGrid::ComputeFaceRows(const Chunk& chunk, uint16_t faces[faceCount][chunkRows]) const
+{
+	// A cell's face is covered when the neighbour on that side is occupied and not moving.
+	// Gather the covering ("solid") rows of this chunk into a padded 18x18 block of rows so that
+	// the rows above, below, in front and behind are plain offsets, with the border filled in
+	// from the neighbouring chunks. Neighbours along x are a shift of the row itself, plus one
+	// carry bit from the chunk on either side.
+	const int pad = chunkSize + 2;
+	uint16_t solid[pad * pad] = {};
+	uint16_t leftCarry[chunkRows] = {};
+	uint16_t rightCarry[chunkRows] = {};
+
+	auto at = [&](int ly, int lz) -> uint16_t& { return solid[(ly + 1) + (lz + 1) * pad]; };
+
+	for (int lz = 0; lz < chunkSize; lz++)
+	{
+		for (int ly = 0; ly < chunkSize; ly++)
+		{
+			int r = RowIndex(ly, lz);
+			at(ly, lz) = chunk.occupied[r] & ~chunk.moving[r];
+		}
+	}
+
+	Chunk* below = FindChunk(chunk.cx, chunk.cy - 1, chunk.cz);
+	Chunk* above = FindChunk(chunk.cx, chunk.cy + 1, chunk.cz);
+	Chunk* front = FindChunk(chunk.cx, chunk.cy, chunk.cz - 1);
+	Chunk* back = FindChunk(chunk.cx, chunk.cy, chunk.cz + 1);
+	Chunk* left = FindChunk(chunk.cx - 1, chunk.cy, chunk.cz);
+	Chunk* right = FindChunk(chunk.cx + 1, chunk.cy, chunk.cz);
+
+	for (int i = 0; i < chunkSize; i++)
+	{
+		int top = RowIndex(0, i), bottom = RowIndex(chunkMask, i);
+		int near = RowIndex(i, chunkMask), far = RowIndex(i, 0);
+
+		if (below != nullptr) at(-1, i) = below->occupied[bottom] & ~below->moving[bottom];
+		if (above != nullptr) at(chunkSize, i) = above->occupied[top] & ~above->moving[top];
+		if (front != nullptr) at(i, -1) = front->occupied[near] & ~front->moving[near];
+		if (back != nullptr) at(i, chunkSize) = back->occupied[far] & ~back->moving[far];
+	}
+
+	for (int r = 0; r < chunkRows; r++)
+	{
+		if (left != nullptr) leftCarry[r] = (uint16_t)(((left->occupied[r] & ~left->moving[r]) >> chunkMask) & 1);
+		if (right != nullptr) rightCarry[r] = (uint16_t)(((right->occupied[r] & ~right->moving[r]) & 1) << chunkMask);
+	}
+
+	// Every row in a z-slice is 16 bits, so each SSE2 register holds eight rows along y and
+	// each face is one offset load or shift and an ANDNOT across eight rows at a time.
+	for (int lz = 0; lz < chunkSize; lz++)
+	{
+		for (int ly = 0; ly < chunkSize; ly += 8)
+		{
+			int r = RowIndex(ly, lz);
+
+#if GRID_SSE2
+			__m128i centre	= _mm_loadu_si128((const __m128i*)&at(ly, lz));
+			__m128i up		= _mm_loadu_si128((const __m128i*)&at(ly + 1, lz));
+			__m128i down	= _mm_loadu_si128((const __m128i*)&at(ly - 1, lz));
+			__m128i behind	= _mm_loadu_si128((const __m128i*)&at(ly, lz + 1));
+			__m128i ahead	= _mm_loadu_si128((const __m128i*)&at(ly, lz - 1));
+
+			__m128i l = _mm_or_si128(_mm_slli_epi16(centre, 1), _mm_loadu_si128((const __m128i*)&leftCarry[r]));
+			__m128i rr = _mm_or_si128(_mm_srli_epi16(centre, 1), _mm_loadu_si128((const __m128i*)&rightCarry[r]));
+
+			__m128i occupied = _mm_loadu_si128((const __m128i*)&chunk.occupied[r]);
+
+			_mm_storeu_si128((__m128i*)&faces[0][r], _mm_andnot_si128(ahead, occupied));
+			_mm_storeu_si128((__m128i*)&faces[1][r], _mm_andnot_si128(behind, occupied));
+			_mm_storeu_si128((__m128i*)&faces[2][r], _mm_andnot_si128(l, occupied));
+			_mm_storeu_si128((__m128i*)&faces[3][r], _mm_andnot_si128(rr, occupied));
+			_mm_storeu_si128((__m128i*)&faces[4][r], _mm_andnot_si128(up, occupied));
+			_mm_storeu_si128((__m128i*)&faces[5][r], _mm_andnot_si128(down, occupied));
+#else
+			for (int i = 0; i < 8; i++)
+			{
+				uint16_t centre = at(ly + i, lz);
+				uint16_t l = (uint16_t)((centre << 1) | leftCarry[r + i]);
+				uint16_t rr = (uint16_t)((centre >> 1) | rightCarry[r + i]);
+
+				uint16_t occupied = chunk.occupied[r + i];
+
+				faces[0][r + i] = occupied & ~at(ly + i, lz - 1);
+				faces[1][r + i] = occupied & ~at(ly + i, lz + 1);
+				faces[2][r + i] = occupied & ~l;
+				faces[3][r + i] = occupied & ~rr;
+				faces[4][r + i] = occupied & ~at(ly + i + 1, lz);
+				faces[5][r + i] = occupied & ~at(ly + i - 1, lz);
+			}
+#endif
+		}
+	}
+}
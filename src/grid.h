@@ -0,0 +1,154 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "entity.h"
+
+// 1 stores a chunk's cells in Morton order, 0 in plain x-major rows. Only there so that
+// gridbench.cpp can be built both ways and the two compared; the game always uses Morton order.
+#ifndef GRID_MORTON
+#define GRID_MORTON 1
+#endif
+
+// Which cube entity sits in each cell of the level.
+// Cells are grouped into 16x16x16 chunks that only exist once something has been put in them,
+// looked up by chunk coordinate in a hash map. Memory follows the occupied part of the level,
+// coordinates can go anywhere (negative included), and the six neighbours of a cell are almost
+// always in the same 16 KB chunk.
+//
+// Within a chunk the cells are stored in Morton (Z-curve) order, with the bits of the x, y and z
+// coordinates interleaved. Stepping along y or z then stays within a few cache lines most of the
+// time, where x-major storage put a +z neighbour 1 KB away. Whether that pays for the extra bit
+// twiddling depends on the machine: gridbench.cpp times both layouts.
+//
+// Alongside the handles, each chunk keeps bitsets with one 16-bit word per row of cells along x:
+// which cells are occupied and which hold a cube that is mid-move.
+//
+// Face masks use one bit per face, in the same order as Face:
+// front (-z), back (+z), left (-x), right (+x), top (+y), bottom (-y).
+// A face is exposed unless the neighbour on that side is occupied and at rest.
+class VoxelGrid
+{
+public:
+	static const int chunkBits = 4;
+	static const int chunkSize = 1 << chunkBits;
+	static const int chunkMask = chunkSize - 1;
+	static const int chunkVolume = chunkSize * chunkSize * chunkSize;
+	static const int chunkRows = chunkSize * chunkSize;
+
+	static const int faceCount = 6;
+	static const uint8_t allFaces = (1 << faceCount) - 1;
+
+	// The step to the cell on the other side of each face, in Face order, and the axis (0 x, 1 y, 2 z) it is along.
+	static constexpr int faceDirections[faceCount][3] = { { 0, 0, -1 }, { 0, 0, 1 }, { -1, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 } };
+	static constexpr int faceAxes[faceCount] = { 2, 2, 0, 0, 1, 1 };
+
+	struct Chunk
+	{
+		int cx;
+		int cy;
+		int cz;
+
+		int count = 0;	// Occupied cells; the chunk is freed when this drops back to zero.
+
+		// Indexed by CellIndex, in Morton order.
+		EntityHandle cells[chunkVolume];
+
+		// Indexed by RowIndex(ly, lz); bit lx is the cell at x = lx.
+		uint16_t occupied[chunkRows] = {};
+		uint16_t moving[chunkRows] = {};
+
+		// Set whenever a cell in this chunk, or one touching it from a neighbouring chunk, changes,
+		// so that whatever is cached per chunk (the static cube meshes) knows to rebuild.
+		bool dirty = true;
+	};
+
+	EntityHandle Get(int x, int y, int z) const;
+	void Set(int x, int y, int z, EntityHandle entity);
+	void Clear(int x, int y, int z);
+
+	// Marks the cube in a cell as moving or at rest. Moving cubes don't hide their neighbours' faces.
+	void SetMoving(int x, int y, int z, bool moving);
+
+	// Occupied and at rest, so it hides the faces of whatever is next to it.
+	bool IsSolid(int x, int y, int z) const;
+
+	uint8_t ExposedFaces(int x, int y, int z) const;
+
+	// The handles in a cell and in the six cells around it, in Face order after the cell itself.
+	// Costs one chunk lookup instead of seven unless the cell is on the edge of its chunk.
+	void GetNeighbourhood(int x, int y, int z, EntityHandle out[1 + faceCount]) const;
+
+	Chunk* FindChunk(int cx, int cy, int cz) const;
+	Chunk* FindChunk(uint64_t key) const;
+
+	int ChunkCount() const;
+	void CollectChunks(std::vector<Chunk*>& out) const;
+
+	// Hands over the keys of the chunks freed since the last call, for whatever is cached per chunk.
+	// Nothing is kept until the first call, so grids nobody draws (the solver's) don't pile them up.
+	void TakeFreedChunks(std::vector<uint64_t>& out);
+
+	// Flags the chunks holding a cell and its six neighbours.
+	void MarkDirty(int x, int y, int z);
+
+	// ExposedFaces for a whole chunk at once, for when a level is built in bulk:
+	// faces[f][row] has bit lx set when that cell is occupied and its face f is exposed.
+	// Only reads the grid, so different chunks can be done on different threads.
+	void ComputeFaceRows(const Chunk& chunk, uint16_t faces[faceCount][chunkRows]) const;
+
+	static int CellIndex(int lx, int ly, int lz)
+	{
+#if GRID_MORTON
+		return mortonSpread[lx] | (mortonSpread[ly] << 1) | (mortonSpread[lz] << 2);
+#else
+		return lx | (ly << chunkBits) | (lz << (2 * chunkBits));
+#endif
+	}
+
+	// The index of the cell one step along an axis, worked out on the interleaved bits directly:
+	// filling the other axes' bits with ones lets a carry run straight through them.
+	// Only meaningful when the step stays inside the chunk.
+	static int CellStep(int cell, int axis, int delta)
+	{
+#if GRID_MORTON
+		int mask = mortonMasks[axis];
+		int moved = delta > 0 ? ((cell | ~mask) + 1) & mask : ((cell & mask) - 1) & mask;
+
+		return moved | (cell & ~mask);
+#else
+		return cell + delta * (1 << (axis * chunkBits));
+#endif
+	}
+
+	static int RowIndex(int ly, int lz)
+	{
+		return ly | (lz << chunkBits);
+	}
+
+	// Arithmetic shifts, so negative coordinates land in the chunk below zero rather than chunk 0.
+	static int ChunkCoord(int v) { return v >> chunkBits; }
+	static int LocalCoord(int v) { return v & chunkMask; }
+
+	static uint64_t ChunkKey(int cx, int cy, int cz)
+	{
+		const uint64_t mask = (1ull << 21) - 1;
+		return ((uint64_t)cx & mask) | (((uint64_t)cy & mask) << 21) | (((uint64_t)cz & mask) << 42);
+	}
+
+private:
+	// mortonSpread[v] has bit k of v moved to bit 3k.
+	static constexpr uint16_t mortonSpread[chunkSize] = { 0, 1, 8, 9, 64, 65, 72, 73, 512, 513, 520, 521, 576, 577, 584, 585 };
+	static constexpr int mortonMasks[3] = { 0x249, 0x492, 0x924 };
+
+	std::unordered_map<uint64_t, std::unique_ptr<Chunk>> chunks;
+
+	bool trackFreed = false;
+	std::vector<uint64_t> freedChunks;
+};
+
+#endif
@@ -0,0 +1,215 @@
+// gridbench.cpp
+//
+// Times VoxelGrid's neighbourhood and exposure queries on a large random level. Built twice, once with
+// cells in Morton order and once (GRID_MORTON 0) in plain x-major rows, so the two layouts can be
+// compared on the same machine:
+//
+//   unending_gridbench [size] [rounds]
+//   unending_gridbench_rows [size] [rounds]
+//
+// The level is size x size/2 x size cells (96 by default), densely filled in its lower half and sparsely
+// above, like structures standing on a floor. Before anything is timed, every neighbourhood is checked
+// against plain Get, so a run doubles as a check of the layout; the checksums at the end should come out
+// the same for both builds.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "grid.h"
+
+struct Cell
+{
+	int x, y, z;
+};
+
+// xorshift, so that both builds fill the same level.
+static uint32_t Random(uint32_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+// Runs query over every cell rounds times, and prints how long each cell took on average.
+template <typename F>
+static uint64_t Time(const char* name, const std::vector<Cell>& cells, int rounds, F&& query)
+{
+	uint64_t checksum = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	for (int round = 0; round < rounds; round++)
+	{
+		for (int i = 0; i < cells.size(); i++)
+		{
+			checksum += query(cells[i]);
+		}
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << name << ": " << seconds * 1e9 / ((double)cells.size() * rounds) << " ns a cell\n";
+
+	return checksum;
+}
+
+int main(int argc, char** argv)
+{
+	int size = argc > 1 ? std::atoi(argv[1]) : 96;
+	int rounds = argc > 2 ? std::atoi(argv[2]) : 10;
+
+	if (size < 2 || rounds < 1)
+	{
+		std::cout << "Usage: unending_gridbench [size] [rounds]\n";
+		return 2;
+	}
+
+	int width = size, height = size / 2, depth = size;
+
+	VoxelGrid grid;
+	std::vector<Cell> scan;		// Every occupied cell, x fastest, then y, then z.
+	uint32_t state = 2463534242u;
+
+	for (int z = 0; z < depth; z++)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				int percent = y < height / 2 ? 70 : 10;
+				if (Random(state) % 100 >= percent) continue;
+
+				grid.Set(x, y, z, EntityHandle::Make((uint32_t)scan.size() + 1, 1));
+				scan.push_back({ x, y, z });
+			}
+		}
+	}
+
+	// The same cells in no particular order, the way moves touch them.
+	std::vector<Cell> shuffled = scan;
+	for (int i = (int)shuffled.size() - 1; i > 0; i--)
+	{
+		std::swap(shuffled[i], shuffled[Random(state) % (i + 1)]);
+	}
+
+#if GRID_MORTON
+	std::cout << "Cells in Morton order, ";
+#else
+	std::cout << "Cells in x-major rows, ";
+#endif
+	std::cout << width << " x " << height << " x " << depth << ", " << scan.size() << " cubes, " << grid.ChunkCount() << " chunks\n";
+
+	// Every neighbourhood, including the cells around the level, against seven separate lookups.
+	for (int z = -1; z <= depth; z++)
+	{
+		for (int y = -1; y <= height; y++)
+		{
+			for (int x = -1; x <= width; x++)
+			{
+				EntityHandle neighbourhood[1 + VoxelGrid::faceCount];
+				grid.GetNeighbourhood(x, y, z, neighbourhood);
+
+				bool same = neighbourhood[0] == grid.Get(x, y, z);
+
+				for (int f = 0; f < VoxelGrid::faceCount; f++)
+				{
+					same = same && neighbourhood[1 + f] == grid.Get(x + VoxelGrid::faceDirections[f][0], y + VoxelGrid::faceDirections[f][1], z + VoxelGrid::faceDirections[f][2]);
+				}
+
+				if (!same)
+				{
+					std::cout << "GetNeighbourhood disagrees with Get at " << x << ", " << y << ", " << z << '\n';
+					return 1;
+				}
+			}
+		}
+	}
+
+	auto neighbourhood = [&](const Cell& c) -> uint64_t
+	{
+		EntityHandle cells[1 + VoxelGrid::faceCount];
+		grid.GetNeighbourhood(c.x, c.y, c.z, cells);
+
+		uint64_t sum = 0;
+		for (int i = 0; i < 1 + VoxelGrid::faceCount; i++) sum += cells[i].value;
+		return sum;
+	};
+
+	auto sevenGets = [&](const Cell& c) -> uint64_t
+	{
+		uint64_t sum = grid.Get(c.x, c.y, c.z).value;
+
+		for (int f = 0; f < VoxelGrid::faceCount; f++)
+		{
+			sum += grid.Get(c.x + VoxelGrid::faceDirections[f][0], c.y + VoxelGrid::faceDirections[f][1], c.z + VoxelGrid::faceDirections[f][2]).value;
+		}
+
+		return sum;
+	};
+
+	auto exposed = [&](const Cell& c) -> uint64_t
+	{
+		return grid.ExposedFaces(c.x, c.y, c.z);
+	};
+
+	uint64_t checksums[5];
+	checksums[0] = Time("GetNeighbourhood, in order", scan, rounds, neighbourhood);
+	checksums[1] = Time("GetNeighbourhood, shuffled", shuffled, rounds, neighbourhood);
+	checksums[2] = Time("Get seven times, in order ", scan, rounds, sevenGets);
+	checksums[3] = Time("Get seven times, shuffled ", shuffled, rounds, sevenGets);
+	checksums[4] = Time("ExposedFaces, shuffled    ", shuffled, rounds, exposed);
+
+	// A flood fill over everything that touches, one structure at a time, the way PuzzleSim finds what a
+	// roll carries: every step is a neighbourhood lookup from the cell before.
+	{
+		std::vector<uint8_t> visited(scan.size() + 1, 0);
+		std::vector<Cell> stack;
+		uint64_t structures = 0;
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (int round = 0; round < rounds; round++)
+		{
+			std::fill(visited.begin(), visited.end(), 0);
+
+			for (int i = 0; i < scan.size(); i++)
+			{
+				if (visited[i + 1]) continue;
+
+				visited[i + 1] = 1;
+				stack.push_back(scan[i]);
+				structures++;
+
+				while (stack.size() > 0)
+				{
+					Cell c = stack.back();
+					stack.pop_back();
+
+					EntityHandle cells[1 + VoxelGrid::faceCount];
+					grid.GetNeighbourhood(c.x, c.y, c.z, cells);
+
+					for (int f = 0; f < VoxelGrid::faceCount; f++)
+					{
+						uint32_t index = cells[1 + f].Index();
+						if (cells[1 + f].IsNull() || visited[index]) continue;
+
+						visited[index] = 1;
+						stack.push_back({ c.x + VoxelGrid::faceDirections[f][0], c.y + VoxelGrid::faceDirections[f][1], c.z + VoxelGrid::faceDirections[f][2] });
+					}
+				}
+			}
+		}
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Flood fill                : " << seconds * 1e9 / ((double)scan.size() * rounds) << " ns a cell, " << structures / rounds << " structures\n";
+	}
+
+	std::cout << "Checksums:";
+	for (int i = 0; i < 5; i++) std::cout << ' ' << checksums[i];
+	std::cout << '\n';
+
+	return 0;
+}
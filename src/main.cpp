@@ -13,9 +13,11 @@
 #include "game.h"
 #include "ecs.h"
 #include "util.h"
+#include "threadpool.h"
 
 Game Game::main;
 ECS ECS::main;
+NameTable NameTable::main;
 
 static int windowMoved = 0;
 void WindowPosCallback(GLFWwindow* window, int xpos, int ypos)
@@ -191,6 +193,7 @@ int main(void)
 	// \Main Loop
 
 	// Shutdown
+	ThreadPool::main.Stop();
 	glfwTerminate();
 	return 0;
 }
\ No newline at end of file
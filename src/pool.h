@@ -0,0 +1,113 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+static const size_t cacheLineSize = 64;
+
+// Hands out fixed-size blocks carved from cache-line aligned slabs.
+// Freed blocks go on a free list and are handed straight back out, so a type that is
+// created and destroyed all the time (a cube's movements during a roll, say) settles into
+// a fixed set of slabs instead of going back to the heap every time.
+// Each block is rounded up to whole cache lines so neighbouring objects never share one,
+// which matters now that movers are updated from several threads at once.
+template <size_t Size>
+class BlockPool
+{
+public:
+	static BlockPool main;
+
+	static constexpr size_t blockSize = (Size + cacheLineSize - 1) / cacheLineSize * cacheLineSize;
+	static constexpr int blocksPerSlab = 64;
+
+	~BlockPool()
+	{
+		for (int i = 0; i < slabs.size(); i++)
+		{
+			::operator delete(slabs[i], std::align_val_t(cacheLineSize));
+		}
+	}
+
+	void* Allocate()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (freeList == nullptr) Grow();
+
+		FreeBlock* block = freeList;
+		freeList = block->next;
+
+		return block;
+	}
+
+	void Free(void* p)
+	{
+		if (p == nullptr) return;
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		FreeBlock* block = (FreeBlock*)p;
+		block->next = freeList;
+		freeList = block;
+	}
+
+private:
+	struct FreeBlock
+	{
+		FreeBlock* next;
+	};
+
+	std::mutex mutex;
+	FreeBlock* freeList = nullptr;
+	std::vector<void*> slabs;
+
+	void Grow()
+	{
+		char* slab = (char*)::operator new(blockSize * blocksPerSlab, std::align_val_t(cacheLineSize));
+		slabs.push_back(slab);
+
+		// Thread the new blocks onto the free list back to front, so they come out in address order.
+		for (int i = blocksPerSlab - 1; i >= 0; i--)
+		{
+			FreeBlock* block = (FreeBlock*)(slab + i * blockSize);
+			block->next = freeList;
+			freeList = block;
+		}
+	}
+};
+
+template <size_t Size>
+BlockPool<Size> BlockPool<Size>::main;
+
+// Routes new and delete for T through the pool for T's size (types of the same size share one).
+// A subclass that inherits this without adding its own comes through with a different size;
+// those fall back to the heap rather than overrunning a block.
+// Anything deleted through a base pointer needs a virtual destructor, so the size that
+// reaches operator delete is the real one.
+template <typename T>
+class Pooled
+{
+public:
+	static void* operator new(size_t size)
+	{
+		if (size != sizeof(T)) return ::operator new(size);
+
+		return BlockPool<sizeof(T)>::main.Allocate();
+	}
+
+	static void operator delete(void* p, size_t size)
+	{
+		if (size != sizeof(T))
+		{
+			::operator delete(p);
+			return;
+		}
+
+		BlockPool<sizeof(T)>::main.Free(p);
+	}
+};
+
+#endif
@@ -0,0 +1,635 @@
+#include "puzzlesim.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "threadpool.h"
+
+#pragma region Map
+
+glm::vec3 PuzzleSim::CubeToWorldSpace(int x, int y, int z)
+{
+	return glm::vec3((float)cubeSize * x, (float)cubeSize * y, (float)cubeSize * -z);
+}
+
+glm::vec3 PuzzleSim::WorldToCubeSpace(glm::vec3 position)
+{
+	return glm::vec3((int)(position.x / cubeSize), (int)(position.y / cubeSize), (int)(-position.z / cubeSize));
+}
+
+void PuzzleSim::Place(int x, int y, int z, EntityHandle cube, uint8_t type)
+{
+	// Whatever was there before is replaced, and drops out of the hash.
+	Remove(x, y, z);
+
+	grid.Set(x, y, z, cube);
+
+	if (cube.Index() >= stamps.size())
+	{
+		stamps.resize(cube.Index() + 1, 0);
+		types.resize(cube.Index() + 1, 0);
+	}
+
+	types[cube.Index()] = type;
+	hash ^= CellKey(glm::ivec3(x, y, z), type);
+}
+
+void PuzzleSim::Remove(int x, int y, int z)
+{
+	EntityHandle cube = grid.Get(x, y, z);
+	if (cube.IsNull()) return;
+
+	hash ^= CellKey(glm::ivec3(x, y, z), types[cube.Index()]);
+	grid.Clear(x, y, z);
+}
+
+void PuzzleSim::Subscribe(std::function<void(const MoveEvent&)> listener)
+{
+	listeners.push_back(listener);
+}
+
+#pragma endregion
+
+#pragma region Moves
+
+bool PuzzleSim::Walk(SimActor& actor, int dX, int dY, int dZ)
+{
+	// The actor can step onto a neighbouring cube as long as there's room to stand on it.
+	glm::ivec3 target = actor.cell + glm::ivec3(dX, dY, dZ);
+	EntityHandle targetCube = grid.Get(target.x, target.y, target.z);
+
+	if (targetCube.IsNull()) return false;
+	if (Occupied(target + glm::ivec3(Util::GetRelativeUp(actor.face)))) return false;
+
+	event.type = MoveType::walk;
+	event.before = actor;
+	event.cubes.clear();
+
+	actor.cube = targetCube;
+	actor.cell = target;
+
+	Finish(actor);
+	return true;
+}
+
+bool PuzzleSim::Roll(SimActor& actor, Face rollDirection)
+{
+	glm::ivec3 activeCell = actor.cell;
+
+	// We're (maybe) going to want to check possible landing points from non-initial circumstances, so
+	// we copy them into more variables so that we can change these while preserving the inputs.
+	Face activeFace = actor.face;
+	Face roll = rollDirection;
+
+	event.before = actor;
+
+	// All rotations expect a fulcrum.
+	std::pair<Face, bool> fulcrum = FindFulcrum(activeCell, activeFace, roll);
+	if (fulcrum.second == false) return false;
+
+	glm::ivec3 fulcrumCell = activeCell + glm::ivec3(Util::GetRelativeUp(fulcrum.first));
+	DetermineStructure(actor.cube, activeCell, fulcrumCell, rollDirection);
+
+	std::vector<CubeMove>& affectedCubes = event.cubes;
+	if (affectedCubes.size() == 0) return false;
+
+	// Now that we know we have a fulcrum, we want to figure out the axis upon which the cube is rotating.
+	// This is a function of the position of the fulcrum, the face the player is standing on, and the roll direction.
+	roll = DetermineRollDirection(fulcrum.first, activeFace, roll);
+
+	// If another cube is in the way of the active cube, the whole roll is off.
+	glm::ivec3 rollUp = glm::ivec3(Util::GetRelativeUp(roll));
+	if (Occupied(activeCell + rollUp)) return false;
+
+	// The same goes for the cell above that, unless it's part of the structure that's rolling.
+	glm::ivec3 blockerCell = activeCell + rollUp + glm::ivec3(Util::GetRelativeUp(actor.face));
+	EntityHandle blocker = grid.Get(blockerCell.x, blockerCell.y, blockerCell.z);
+
+	if (!blocker.IsNull() && affectedCubes.size() > 1)
+	{
+		auto result = std::find_if(affectedCubes.begin(), affectedCubes.end(), [&](const CubeMove& c) { return c.cube == blocker; });
+		if (result == affectedCubes.end()) return false;
+	}
+
+	// Now, we have the "real" direction we're going to be rolling.
+	// We always want to roll "towards" the fulcrum, and land on whatever is past it.
+	glm::ivec3 landingCell = activeCell + glm::ivec3(Util::GetLandingCoords(fulcrum.first, roll));
+
+	if (Occupied(landingCell))
+	{
+		// The face we're landing on is the opposite of the fulcrum,
+		// at least so long as we're doing only a 90 degree rotation.
+		Face landingFace = Util::OppositeFace(fulcrum.first);
+
+		// We need to make sure that the player won't get stuck on any cubes while rolling.
+		glm::ivec3 landingCubePosition = landingCell + glm::ivec3(Util::GetRelativeUp(landingFace));
+		if (Occupied(landingCubePosition + glm::ivec3(Util::GetRelativeUp(rollDirection)))) return false;
+
+		return QuarterRoll(actor, rollDirection, roll, landingCell, landingFace);
+	}
+
+	// Nothing to land on after 90 degrees, so the cube has to go another 90, onto the fulcrum itself.
+	// A cube can only rotate 180 degrees, no more, and only a lone cube can make it that far.
+	landingCell = fulcrumCell;
+
+	if (Occupied(landingCell) && affectedCubes.size() == 1)
+	{
+		// We need to make sure that the player won't get stuck on any cubes while rolling.
+		glm::ivec3 landingCubePosition = landingCell + glm::ivec3(Util::GetRelativeUp(roll));
+		if (Occupied(landingCubePosition + glm::ivec3(Util::GetRelativeUp(Util::OppositeFace(actor.face))))) return false;
+
+		// We can assume that the landing face is the same as our roll direction.
+		return HalfRoll(actor, Util::OppositeFace(actor.face), Util::OppositeFace(fulcrum.first), roll, landingCell, roll);
+	}
+
+	// This means we couldn't find a suitable landing position and thus shouldn't roll the cubes at all.
+	return false;
+}
+
+std::pair<Face, bool> PuzzleSim::FindFulcrum(glm::ivec3 activeCell, Face activeFace, Face rollDirection)
+{
+	// This serves to find the cube off which any rotating cube should intuitively push.
+	// This will usually be right below the cube, but this should also account for when
+	// the player is pushing a cube perpendicular to the surface it should land on
+	// rather than parallel to it.
+
+	// First we'll check right below the active cube (relative to the direction being pushed).
+	glm::vec3 expectedDirection = -Util::GetRelativeUp(activeFace);
+
+	if (Occupied(activeCell + glm::ivec3(expectedDirection)))
+	{
+		return std::pair<Face, bool>(Util::GetFaceFromDifference(expectedDirection), true);
+	}
+
+	// Then opposite the rolling direction, which warrants the same reaction.
+	expectedDirection = -Util::GetRelativeUp(rollDirection);
+
+	if (Occupied(activeCell + glm::ivec3(expectedDirection)))
+	{
+		return std::pair<Face, bool>(Util::GetFaceFromDifference(expectedDirection), true);
+	}
+
+	// In this case, neither of the allowed fulcrum points can be found.
+	return std::pair<Face, bool>(Util::GetFaceFromDifference(expectedDirection), false);
+}
+
+Face PuzzleSim::DetermineRollDirection(Face fulcrum, Face activeFace, Face rollDirection)
+{
+	glm::vec3 fulcrumUp = Util::GetRelativeUp(fulcrum);
+	glm::vec3 activeDown = -Util::GetRelativeUp(activeFace);
+
+	// If the fulcrum is right below the face the actor is standing on,
+	// then we want to roll in the direction specified by rollDirection.
+	if (fulcrumUp == activeDown)
+	{
+		return rollDirection;
+	}
+
+	// If the fulcrum is below the roll direction, then we want to move opposite the activeFace.
+	if (fulcrumUp == -Util::GetRelativeUp(rollDirection))
+	{
+		return Util::GetFaceFromDifference(activeDown);
+	}
+
+	// These are technically the only inputs we expect to receive, but just in case:
+	return rollDirection;
+}
+
+void PuzzleSim::FloodFill(std::vector<CubeMove>& inside, glm::ivec3 start, glm::ivec3 activeCell, glm::ivec3 fulcrumCell)
+{
+	// Cubes are stamped as soon as they're reached, rather than searched for in what has been found
+	// so far, and the cubes still to visit sit on a stack of our own instead of the call stack.
+	// So a fill is linear in the size of the structure and a big one can't overflow anything.
+	// The caller starts a fill by bumping fillStamp; anything it stamps beforehand is left out.
+	fillStack.clear();
+
+	EntityHandle first = grid.Get(start.x, start.y, start.z);
+
+	if (stamps[first.Index()] != fillStamp)
+	{
+		stamps[first.Index()] = fillStamp;
+		fillStack.push_back({ first, start, start, start });
+	}
+
+	while (fillStack.size() > 0)
+	{
+		CubeMove c = fillStack.back();
+		fillStack.pop_back();
+
+		// Only cubes nearer the active cube than the fulcrum belong to the structure.
+		glm::ivec3 toCube = activeCell - c.from;
+		glm::ivec3 toFulcrum = fulcrumCell - c.from;
+
+		if (toCube.x * toCube.x + toCube.y * toCube.y + toCube.z * toCube.z >= toFulcrum.x * toFulcrum.x + toFulcrum.y * toFulcrum.y + toFulcrum.z * toFulcrum.z) continue;
+
+		inside.push_back(c);
+
+		EntityHandle neighbourhood[1 + VoxelGrid::faceCount];
+		grid.GetNeighbourhood(c.from.x, c.from.y, c.from.z, neighbourhood);
+
+		for (int f = 0; f < VoxelGrid::faceCount; f++)
+		{
+			EntityHandle next = neighbourhood[1 + f];
+			if (next.IsNull() || stamps[next.Index()] == fillStamp) continue;
+
+			stamps[next.Index()] = fillStamp;
+
+			glm::ivec3 cell = c.from + glm::ivec3(VoxelGrid::faceDirections[f][0], VoxelGrid::faceDirections[f][1], VoxelGrid::faceDirections[f][2]);
+			fillStack.push_back({ next, cell, cell, cell });
+		}
+	}
+}
+
+void PuzzleSim::DetermineStructure(EntityHandle cube, glm::ivec3 cell, glm::ivec3 fulcrumCell, Face direction)
+{
+	std::vector<CubeMove>& retCubes = event.cubes;
+	retCubes.clear();
+	retCubes.push_back({ cube, cell, cell, cell });
+
+	glm::ivec3 startCell = cell + glm::ivec3(Util::GetRelativeUp(direction));
+	if (!Occupied(startCell)) return;
+
+	// The fill doesn't pass back through the cube it started beside.
+	fillStamp++;
+	stamps[cube.Index()] = fillStamp;
+
+	FloodFill(retCubes, startCell, cell, fulcrumCell);
+
+	if (retCubes.size() < 4) return;
+
+	int touchingSidesFulcrum = 0;
+	bool tf = false,
+		tb = false,
+		tr = false,
+		tl = false,
+		tu = false,
+		td = false;
+
+	for (int i = 1; i < retCubes.size(); i++)
+	{
+		glm::ivec3 diff = retCubes[i].from - cell;
+
+		if (diff == glm::ivec3(1, 0, 0)) tr = true;
+		else if (diff == glm::ivec3(-1, 0, 0)) tl = true;
+		else if (diff == glm::ivec3(0, 1, 0)) tu = true;
+		else if (diff == glm::ivec3(0, -1, 0)) td = true;
+		else if (diff == glm::ivec3(0, 0, 1)) tb = true;
+		else if (diff == glm::ivec3(0, 0, -1)) tf = true;
+
+		glm::ivec3 toFulcrum = glm::abs(fulcrumCell - retCubes[i].from);
+		if (toFulcrum.x + toFulcrum.y + toFulcrum.z == 1) touchingSidesFulcrum++;
+	}
+
+	// A structure wrapped around the cube the wrong way, or clinging to the fulcrum, can't roll.
+	if ((tf && direction == Face::back) ||
+		(tb && direction == Face::front) ||
+		(tr && direction == Face::left) ||
+		(tl && direction == Face::right) ||
+		(tu && direction == Face::bottom) ||
+		(td && direction == Face::top) ||
+		touchingSidesFulcrum > 2)
+	{
+		retCubes.clear();
+	}
+}
+
+#pragma endregion
+
+#pragma region Sweeps
+
+void PuzzleSim::MarkStructure(const std::vector<CubeMove>& cubes)
+{
+	fillStamp++;
+
+	for (int i = 0; i < cubes.size(); i++)
+	{
+		stamps[cubes[i].cube.Index()] = fillStamp;
+	}
+}
+
+// How far a structure can roll before one of its cubes runs into something: the smallest SweepPath
+// over all of them, each headed from its from cell to its target.
+float PuzzleSim::SweepStructure(const std::vector<CubeMove>& cubes, Face roll, Face up, EntityHandle passable)
+{
+	static const int chunkSize = 1024;
+
+	MarkStructure(cubes);
+
+	// Filling in the tables is the only part that writes anything, so it happens up front, here.
+	sweepPaths.resize(cubes.size());
+
+	for (int i = 0; i < cubes.size(); i++)
+	{
+		sweepPaths[i] = &GetSweep(cubes[i].target - cubes[i].from, roll, up);
+	}
+
+	// After that every cube is checked on its own against a grid that nobody is changing, so the
+	// structure is split into chunks that each find their own minimum. A min doesn't care what order
+	// it is taken in, so the result is the same however the chunks are shared out. Once any cube
+	// is stuck outright nothing can beat 0, and the remaining chunks skip their work.
+	int chunks = ((int)cubes.size() + chunkSize - 1) / chunkSize;
+	sweepResults.assign(chunks, 1.0f);
+
+	std::atomic<bool> stuck{ false };
+
+	ThreadPool::main.ParallelFor((int)cubes.size(), chunkSize, [&](int chunk, int begin, int end)
+	{
+		float minT = 1.0f;
+
+		for (int i = begin; i < end && minT > 0.0f && !stuck; i++)
+		{
+			minT = std::min(minT, SweepPath(cubes[i].from, *sweepPaths[i], passable));
+		}
+
+		if (minT == 0.0f) stuck = true;
+		sweepResults[chunk] = minT;
+	});
+
+	float minT = 1.0f;
+
+	for (int i = 0; i < chunks; i++)
+	{
+		minT = std::min(minT, sweepResults[i]);
+	}
+
+	return stuck ? 0.0f : minT;
+}
+
+// How far along its roll path a cube in a rolling structure can get before it runs into a cube
+// that isn't part of the structure (see MarkStructure) or the passable one.
+// Returns 1 if the path is clear, 0 if the cube can't even leave its cell, and otherwise a t inside the
+// last free cell it reaches.
+float PuzzleSim::SweepPath(glm::ivec3 cell, const std::vector<SweptCell>& sweep, EntityHandle passable) const
+{
+	float lastSafeT = 0.0f;
+
+	for (int i = 0; i < sweep.size(); i++)
+	{
+		const SweptCell& swept = sweep[i];
+		if (swept.dx == 0 && swept.dy == 0 && swept.dz == 0) continue;
+
+		EntityHandle other = grid.Get(cell.x + swept.dx, cell.y + swept.dy, cell.z + swept.dz);
+
+		if (!other.IsNull() && other != passable && stamps[other.Index()] != fillStamp) return lastSafeT;
+
+		lastSafeT = swept.t;
+	}
+
+	return 1.0f;
+}
+
+uint64_t PuzzleSim::SweepKey(glm::ivec3 offset, Face roll, Face up)
+{
+	return ((uint64_t)offset.x & 0xFFFF) | (((uint64_t)offset.y & 0xFFFF) << 16) | (((uint64_t)offset.z & 0xFFFF) << 32) |
+		((uint64_t)roll << 48) | ((uint64_t)up << 52);
+}
+
+// The path is the Bezier the cubes are animated along, laid out from the origin.
+// Rather than sampling it at fixed steps, this finds every t at which it crosses from one cell into the
+// next, so each cell on it is listed exactly once and no corner can be stepped over.
+const std::vector<SweptCell>& PuzzleSim::GetSweep(glm::ivec3 offset, Face roll, Face up)
+{
+	std::vector<SweptCell>& sweep = sweepTables[SweepKey(offset, roll, up)];
+	if (sweep.size() > 0) return sweep;
+
+	glm::vec3 forwardDir = Util::GetRelativeUp(roll);
+	if (forwardDir.z != 0) forwardDir *= -1.0f;
+	glm::vec3 upDir = Util::GetRelativeUp(up);
+	if (upDir.z != 0) upDir *= -1.0f;
+
+	glm::vec3 p0 = { 0.0f, 0.0f, 0.0f };
+	glm::vec3 p3 = CubeToWorldSpace(offset.x, offset.y, offset.z);
+	float length = glm::length(p3) * cos(45) * (2.0 / 3.0f);
+	glm::vec3 p1 = p0 + (forwardDir * length);
+	glm::vec3 p2 = p3 + (upDir * length);
+
+	// The path in power form: ((a t + b) t + c) t + d.
+	glm::vec3 a = -p0 + 3.0f * p1 - 3.0f * p2 + p3;
+	glm::vec3 b = 3.0f * p0 - 6.0f * p1 + 3.0f * p2;
+	glm::vec3 c = -3.0f * p0 + 3.0f * p1;
+	glm::vec3 d = p0;
+
+	auto pointAt = [&](float t) { return ((a * t + b) * t + c) * t + d; };
+
+	std::vector<float>& crossings = sweepCrossings;
+	crossings.clear();
+	crossings.push_back(0.0f);
+	crossings.push_back(1.0f);
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		// Split the path where it turns back along this axis, so that each piece only runs one way.
+		// The turning points are the roots of the derivative, 3a t^2 + 2b t + c.
+		float pieces[4] = { 0.0f };
+		int count = 1;
+
+		float qa = 3.0f * a[axis], qb = 2.0f * b[axis], qc = c[axis];
+		float roots[2];
+		int rootCount = 0;
+
+		if (std::abs(qa) < 1e-6f)
+		{
+			if (std::abs(qb) > 1e-6f) roots[rootCount++] = -qc / qb;
+		}
+		else
+		{
+			float discriminant = qb * qb - 4.0f * qa * qc;
+
+			if (discriminant >= 0.0f)
+			{
+				float root = std::sqrt(discriminant);
+				roots[rootCount++] = (-qb - root) / (2.0f * qa);
+				roots[rootCount++] = (-qb + root) / (2.0f * qa);
+
+				if (roots[0] > roots[1]) std::swap(roots[0], roots[1]);
+			}
+		}
+
+		for (int i = 0; i < rootCount; i++)
+		{
+			if (roots[i] > 0.0f && roots[i] < 1.0f) pieces[count++] = roots[i];
+		}
+
+		pieces[count++] = 1.0f;
+
+		for (int i = 0; i + 1 < count; i++)
+		{
+			float t0 = pieces[i], t1 = pieces[i + 1];
+			float u0 = pointAt(t0)[axis] / cubeSize;
+			float u1 = pointAt(t1)[axis] / cubeSize;
+			bool rising = u1 > u0;
+
+			// Every whole cell boundary strictly between the two ends is crossed exactly once on this piece.
+			for (float n = std::floor(std::min(u0, u1)) + 1.0f; n < std::max(u0, u1); n += 1.0f)
+			{
+				float lo = t0, hi = t1;
+
+				for (int step = 0; step < 32; step++)
+				{
+					float mid = (lo + hi) / 2.0f;
+
+					if ((pointAt(mid)[axis] / cubeSize < n) == rising) lo = mid;
+					else hi = mid;
+				}
+
+				crossings.push_back((lo + hi) / 2.0f);
+			}
+		}
+	}
+
+	std::sort(crossings.begin(), crossings.end());
+
+	for (int i = 0; i + 1 < crossings.size(); i++)
+	{
+		if (crossings[i + 1] <= crossings[i]) continue;
+
+		// Between two crossings the path stays in one cell. The path starts on a cell corner, so relative
+		// to it, cells are whole steps of cubeSize (with z flipped, as in WorldToCubeSpace).
+		float t = (crossings[i] + crossings[i + 1]) / 2.0f;
+		glm::vec3 p = pointAt(t) / (float)cubeSize;
+
+		sweep.push_back({ (int)std::floor(p.x), (int)std::floor(p.y), (int)std::floor(-p.z), t });
+	}
+
+	return sweep;
+}
+
+glm::ivec3 PuzzleSim::StopCell(glm::ivec3 from, glm::ivec3 target, Face roll, Face up, float t)
+{
+	glm::vec3 start = CubeToWorldSpace(from.x, from.y, from.z);
+	glm::vec3 end = CubeToWorldSpace(target.x, target.y, target.z);
+
+	glm::vec3 forwardDir = Util::GetRelativeUp(roll);
+	if (forwardDir.z != 0) forwardDir *= -1.0f;
+	glm::vec3 upDir = Util::GetRelativeUp(up);
+	if (upDir.z != 0) upDir *= -1.0f;
+
+	float dist = glm::length(start - end);
+	float length = dist * cos(45) * (2.0 / 3.0f);
+
+	// The same curve, and the same lerps, as the BezierCurve the cube is animated along,
+	// without the allocations, so the cube stops in exactly the cell it is drawn stopping in.
+	glm::vec3 p[4] = { start, start + (forwardDir * length), end + (upDir * length), end };
+
+	for (int n = 3; n > 0; n--)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			p[i] = Util::Lerp(p[i], p[i + 1], t);
+		}
+	}
+
+	return glm::ivec3(WorldToCubeSpace(p[0]));
+}
+
+#pragma endregion
+
+#pragma region Rolls
+
+bool PuzzleSim::QuarterRoll(SimActor& actor, Face standingFace, Face roll, glm::ivec3 landingCell, Face landingFace)
+{
+	std::vector<CubeMove>& affectedCubes = event.cubes;
+
+	// Everything turns about the cell the actor's cube starts in.
+	glm::ivec3 pivot = actor.cell;
+	glm::ivec3 landing = landingCell + glm::ivec3(Util::GetRelativeUp(landingFace));
+
+	// First, we need to sweep the whole cube structure over its whole course to see if it collides with anything.
+	// For that we need to know where each cube is headed, in cube space.
+	Quaternion diffRot = Util::GetRollRotation(landingFace, roll, { 1, 0, 0, 0 }, 1);
+
+	for (int i = 0; i < affectedCubes.size(); i++)
+	{
+		glm::ivec3 d = pivot - affectedCubes[i].from;
+		glm::vec3 newDifference = Util::Rotate(glm::vec3(-d.x, d.y, d.z), diffRot);
+
+		affectedCubes[i].target = landing + glm::ivec3((int)newDifference.x, (int)newDifference.y, (int)newDifference.z);
+	}
+
+	// This is going to be the smallest t value at which a collision occurs.
+	float minT = SweepStructure(affectedCubes, roll, landingFace, EntityHandle());
+	if (minT == 0.0f) return false;
+
+	// A lone cube hops straight onto its landing spot; a structure stops wherever it was blocked.
+	for (int i = 0; i < affectedCubes.size(); i++)
+	{
+		affectedCubes[i].to = affectedCubes.size() > 1 ?
+			StopCell(affectedCubes[i].from, affectedCubes[i].target, roll, landingFace, minT) :
+			affectedCubes[i].target;
+	}
+
+	event.type = MoveType::quarterRoll;
+	event.roll = roll;
+	event.axis = landingFace;
+	event.t = minT;
+
+	actor.cell = affectedCubes[0].to;
+	actor.face = standingFace;
+
+	Finish(actor);
+	return true;
+}
+
+bool PuzzleSim::HalfRoll(SimActor& actor, Face standingFace, Face oppFulcrum, Face roll, glm::ivec3 landingCell, Face landingFace)
+{
+	std::vector<CubeMove>& affectedCubes = event.cubes;
+
+	glm::ivec3 pivot = actor.cell;
+	glm::ivec3 landing = landingCell + glm::ivec3(Util::GetRelativeUp(landingFace));
+
+	Quaternion diffRot = Util::GetRollRotation(oppFulcrum, roll, { 1, 0, 0, 0 }, 1);
+
+	for (int i = 0; i < affectedCubes.size(); i++)
+	{
+		glm::ivec3 d = pivot - affectedCubes[i].from;
+		glm::vec3 newDifference = Util::Rotate(glm::vec3(d.x, d.y, d.z), diffRot);
+
+		affectedCubes[i].target = landing + glm::ivec3((int)newDifference.x, (int)newDifference.y, (int)newDifference.z);
+	}
+
+	// The cube being rolled over is the one thing that is allowed to be in the way.
+	float minT = SweepStructure(affectedCubes, roll, landingFace, grid.Get(landingCell.x, landingCell.y, landingCell.z));
+	if (minT == 0.0f) return false;
+
+	affectedCubes[0].to = landing;
+
+	for (int i = 1; i < affectedCubes.size(); i++)
+	{
+		affectedCubes[i].to = StopCell(affectedCubes[i].from, affectedCubes[i].target, roll, landingFace, minT);
+	}
+
+	event.type = MoveType::halfRoll;
+	event.roll = roll;
+	event.axis = oppFulcrum;
+	event.t = minT;
+
+	actor.cell = landing;
+	actor.face = standingFace;
+
+	Finish(actor);
+	return true;
+}
+
+void PuzzleSim::Finish(SimActor& actor)
+{
+	// Everything comes out before anything goes back in, so cubes can move into each other's old cells.
+	for (int i = 0; i < event.cubes.size(); i++)
+	{
+		Remove(event.cubes[i].from.x, event.cubes[i].from.y, event.cubes[i].from.z);
+	}
+
+	for (int i = 0; i < event.cubes.size(); i++)
+	{
+		Place(event.cubes[i].to.x, event.cubes[i].to.y, event.cubes[i].to.z, event.cubes[i].cube, types[event.cubes[i].cube.Index()]);
+	}
+
+	event.after = actor;
+
+	for (int i = 0; i < listeners.size(); i++)
+	{
+		listeners[i](event);
+	}
+}
+
+#pragma endregion
@@ -0,0 +1,165 @@
+#ifndef PUZZLESIM_H
+#define PUZZLESIM_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "entity.h"
+#include "grid.h"
+#include "util.h"
+
+// One stretch of a roll path spent inside a single cell, relative to the cell the path starts in.
+struct SweptCell
+{
+	int dx;
+	int dy;
+	int dz;
+
+	float t;	// Partway through the stretch.
+};
+
+// Where the player is: the cube they're on, the cell it's in, and the face they're standing on.
+struct SimActor
+{
+	EntityHandle entity;	// Whoever the actor is to the game; the sim only hands it back in events.
+	EntityHandle cube;
+	glm::ivec3 cell;
+	Face face;
+};
+
+enum class MoveType { walk, quarterRoll, halfRoll };
+
+struct CubeMove
+{
+	EntityHandle cube;
+	glm::ivec3 from;
+	glm::ivec3 to;
+	glm::ivec3 target;	// Where the cube was headed. Not the same as to when the roll was cut short.
+};
+
+// Everything that changed in one move, for whoever wants to show it.
+struct MoveEvent
+{
+	MoveType type;
+
+	SimActor before;
+	SimActor after;
+
+	// Rolls only.
+	Face roll;		// The way the structure tips over.
+	Face axis;		// The face it turns about: the landing face for a quarter roll, the far side of the fulcrum for a half.
+	float t;		// How far along its path the structure got before it ran into something; 1 if it didn't.
+
+	std::vector<CubeMove> cubes;	// The cube the actor is on comes first.
+};
+
+// The rules of the puzzle on their own: which cubes are where, and what walking and rolling do to them.
+// No rendering, no input and no animation, so solvers, level checks and tests can step it as fast as they like.
+// The game drives it from input and subscribes to the MoveEvents it produces to animate what happened.
+//
+// Cubes are identified by whatever handle they were placed with; the sim never looks inside them.
+class PuzzleSim
+{
+public:
+	static const int cubeSize = 10;
+
+	VoxelGrid grid;
+
+	// The XOR of CellKey over every cube in the grid, kept up to date by Place and Remove.
+	uint64_t hash = 0;
+
+	static glm::vec3 CubeToWorldSpace(int x, int y, int z);
+	static glm::vec3 WorldToCubeSpace(glm::vec3 position);
+
+	// A type is whatever the caller wants told apart when states are compared; the rules ignore it.
+	void Place(int x, int y, int z, EntityHandle cube, uint8_t type = 0);
+	void Remove(int x, int y, int z);
+
+	// Zobrist keys. The level has no edges, so rather than a table of random numbers per cell
+	// the keys are a strong mix of the coordinates: just as random, and no table to fill.
+	static uint64_t Mix(uint64_t v)
+	{
+		v += 0x9E3779B97F4A7C15ull;
+		v = (v ^ (v >> 30)) * 0xBF58476D1CE4E5B9ull;
+		v = (v ^ (v >> 27)) * 0x94D049BB133111EBull;
+		return v ^ (v >> 31);
+	}
+
+	static uint64_t CellKey(glm::ivec3 cell, uint8_t type)
+	{
+		const uint64_t mask = (1ull << 21) - 1;
+		uint64_t packed = ((uint64_t)cell.x & mask) | (((uint64_t)cell.y & mask) << 21) | (((uint64_t)cell.z & mask) << 42);
+
+		return Mix(Mix(packed) ^ type);
+	}
+
+	static uint64_t ActorKey(glm::ivec3 cell, Face face)
+	{
+		return Mix(CellKey(cell, 0) ^ (0x100 | (uint64_t)face));
+	}
+
+	// The grid and the actor together, in O(1).
+	uint64_t StateHash(const SimActor& actor) const { return hash ^ ActorKey(actor.cell, actor.face); }
+
+	// Listeners are called, in the order they subscribed, after every move that changes anything.
+	void Subscribe(std::function<void(const MoveEvent&)> listener);
+
+	// Both return false, and leave everything as it was, when the move isn't possible.
+	bool Walk(SimActor& actor, int dX, int dY, int dZ);
+	bool Roll(SimActor& actor, Face rollDirection);
+
+private:
+	std::vector<std::function<void(const MoveEvent&)>> listeners;
+
+	// The move being worked out; kept around so that its vectors don't have to be reallocated every time.
+	MoveEvent event;
+
+	// The type each cube was placed with, indexed by handle index.
+	std::vector<uint8_t> types;
+
+	// The last flood fill or structure to reach each cube, indexed by handle index.
+	// Cubes stamped with the current fillStamp have already been reached.
+	std::vector<uint32_t> stamps;
+	uint32_t fillStamp = 0;
+	std::vector<CubeMove> fillStack;
+
+	// The cells every roll path passes through, worked out the first time a path is needed.
+	// Keyed by SweepKey: a path only depends on where it ends relative to where it starts and which way it bends.
+	std::unordered_map<uint64_t, std::vector<SweptCell>> sweepTables;
+	std::vector<float> sweepCrossings;
+	std::vector<const std::vector<SweptCell>*> sweepPaths;
+	std::vector<float> sweepResults;
+
+	bool Occupied(glm::ivec3 cell) const { return !grid.Get(cell.x, cell.y, cell.z).IsNull(); }
+
+	std::pair<Face, bool> FindFulcrum(glm::ivec3 activeCell, Face activeFace, Face rollDirection);
+	Face DetermineRollDirection(Face fulcrum, Face activeFace, Face rollDirection);
+
+	void FloodFill(std::vector<CubeMove>& inside, glm::ivec3 start, glm::ivec3 activeCell, glm::ivec3 fulcrumCell);
+
+	// Fills event.cubes with the structure that rolls along with the active cube, or leaves it empty if it can't roll.
+	void DetermineStructure(EntityHandle cube, glm::ivec3 cell, glm::ivec3 fulcrumCell, Face direction);
+
+	// Stamps the structure's cubes with a fresh fillStamp, so SweepPath can tell them from obstacles.
+	void MarkStructure(const std::vector<CubeMove>& cubes);
+	float SweepStructure(const std::vector<CubeMove>& cubes, Face roll, Face up, EntityHandle passable);
+	float SweepPath(glm::ivec3 cell, const std::vector<SweptCell>& sweep, EntityHandle passable) const;
+
+	static uint64_t SweepKey(glm::ivec3 offset, Face roll, Face up);
+	const std::vector<SweptCell>& GetSweep(glm::ivec3 offset, Face roll, Face up);
+
+	// The cell a cube rolling from one cell towards another is in when the roll stops at t.
+	static glm::ivec3 StopCell(glm::ivec3 from, glm::ivec3 target, Face roll, Face up, float t);
+
+	bool QuarterRoll(SimActor& actor, Face standingFace, Face roll, glm::ivec3 landingCell, Face landingFace);
+	bool HalfRoll(SimActor& actor, Face standingFace, Face oppFulcrum, Face roll, glm::ivec3 landingCell, Face landingFace);
+
+	// Takes the structure out of its old cells and puts it in its new ones, then tells the listeners.
+	void Finish(SimActor& actor);
+};
+
+#endif
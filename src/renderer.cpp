@@ -1,13 +1,14 @@
 #include "renderer.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include "game.h"
 #include "util.h"
 #include <glm/gtx/norm.hpp>
 
-Renderer::Renderer(GLuint whiteTexture) : batches(1), shader("assets/shaders/base.vert", "assets/shaders/base.frag"),
-whiteTextureID(whiteTexture)
+Renderer::Renderer(GLuint whiteTexture) : whiteTextureID(whiteTexture), batches(1), shader("assets/shaders/base.vert", "assets/shaders/base.frag"),
+staticShader("assets/shaders/static.vert", "assets/shaders/static.frag")
 {
 	GLuint IBO;
 
@@ -64,6 +65,10 @@ whiteTextureID(whiteTexture)
 	}
 	glUniform1iv(location, MAX_TEXTURES_PER_BATCH, samplers);
 
+	// Static meshes are drawn a texture at a time, always from unit 0.
+	glUseProgram(staticShader.ID);
+	staticShader.SetInt("meshTexture", 0);
+
 	this->textureIDs.push_back(whiteTexture);
 	this->texturesUsed.push_back(whiteTextureID);
 	whiteTextureIndex = 0.0f;
@@ -100,10 +105,9 @@ Bundle Renderer::DetermineBatch(int textureID)
 	}
 }
 
-void Renderer::PrepareModel(glm::vec3 size, glm::vec3 position, Quaternion q, glm::vec4 color, Model* model)
+void RenderBuffer::PrepareModel(glm::vec3 size, glm::vec3 position, Quaternion q, glm::vec4 color, Model* model)
 {
-	Bundle bundle = DetermineBatch(whiteTextureID);
-	Batch& batch = batches[bundle.batch];
+	int textureID = Game::main.renderer->whiteTextureID;
 
 	int triCount = model->vertices.size() / 3;
 
@@ -124,16 +128,33 @@ void Renderer::PrepareModel(glm::vec3 size, glm::vec3 position, Quaternion q, gl
 		bPos = Util::RotateRelative(position, position + bPos, q);
 		cPos = Util::RotateRelative(position, position + cPos, q);
 
-		Vertex a = { aPos.x, aPos.y, aPos.z, color.r, color.g, color.b, color.a, 0.0f, 0.0f, bundle.location };
-		Vertex b = { bPos.x, bPos.y, bPos.z, color.r, color.g, color.b, color.a, 0.0f, 0.0f, bundle.location };
-		Vertex c = { cPos.x, cPos.y, cPos.z, color.r, color.g, color.b, color.a, 0.0f, 0.0f, bundle.location };
+		Vertex a = { aPos.x, aPos.y, aPos.z, color.r, color.g, color.b, color.a, 0.0f, 0.0f, 0.0f };
+		Vertex b = { bPos.x, bPos.y, bPos.z, color.r, color.g, color.b, color.a, 0.0f, 0.0f, 0.0f };
+		Vertex c = { cPos.x, cPos.y, cPos.z, color.r, color.g, color.b, color.a, 0.0f, 0.0f, 0.0f };
 
-		batch.buffer[batch.index] = { a, b, c };
-		batch.index++;
+		triangles.push_back({ a, b, c });
+		textureIDs.push_back(textureID);
 	}
 }
 
-void Renderer::PrepareCube(glm::vec3 size, glm::vec3 position, Quaternion q, glm::vec4 color, int textureID)
+// The cube-space face that a world-space normal points out of.
+// World z runs the opposite way to cube z, so world +z is the cube's front.
+static Face FaceOf(glm::vec3 normal)
+{
+	glm::vec3 a = glm::abs(normal);
+
+	if (a.x >= a.y && a.x >= a.z) return normal.x > 0.0f ? Face::right : Face::left;
+	if (a.y >= a.z) return normal.y > 0.0f ? Face::top : Face::bottom;
+	return normal.z > 0.0f ? Face::front : Face::back;
+}
+
+static uint8_t FaceBit(glm::vec3 normal)
+{
+	return 1 << (int)FaceOf(normal);
+}
+
+// The six quads of a cube, before any of them are culled.
+static void CubeQuads(glm::vec3 size, glm::vec3 position, Quaternion q, glm::vec4 color, int textureID, Quad& front, Quad& back, Quad& right, Quad& left, Quad& top, Quad& bottom)
 {
 	glm::vec3 closeTopRight		= Util::RotateRelative(	position,	position + glm::vec3(size.x / 2.0f, size.y / 2.0f, -size.z / 2.0f),		q);// *Game::main.zoom;
 	glm::vec3 closeBottomRight	= Util::RotateRelative(	position,	position + glm::vec3(size.x / 2.0f, -size.y / 2.0f, -size.z / 2.0f),	q);// * Game::main.zoom;
@@ -145,17 +166,8 @@ void Renderer::PrepareCube(glm::vec3 size, glm::vec3 position, Quaternion q, glm
 	glm::vec3 farBottomLeft		= Util::RotateRelative(	position,	position + glm::vec3(-size.x / 2.0f, -size.y / 2.0f, size.z / 2.0f),	q);// * Game::main.zoom;
 	glm::vec3 farTopLeft		= Util::RotateRelative(	position,	position + glm::vec3(-size.x / 2.0f, size.y / 2.0f, size.z / 2.0f),		q);// * Game::main.zoom;
 
-	float f = glm::length2(Game::main.cameraForward - Util::Rotate({ 0.0f, 0.0f, 1.0f }, q));
-	float b = glm::length2(Game::main.cameraForward - Util::Rotate({ 0.0f, 0.0f, -1.0f }, q));
-	float u = glm::length2(Game::main.cameraForward - Util::Rotate({ 0.0f, -1.0f, 0.0f }, q));
-	float d = glm::length2(Game::main.cameraForward - Util::Rotate({ 0.0f, 1.0f, 0.0f }, q));
-	float r = glm::length2(Game::main.cameraForward - Util::Rotate({ 1.0f, 0.0f, 0.0f }, q));
-	float l = glm::length2(Game::main.cameraForward - Util::Rotate({ -1.0f, 0.0f, 0.0f }, q));
-
-	float minDiff = 2.0f;
-
 	// Front	- All the close verts.
-	Quad front
+	front =
 	{
 		{
 			{ closeTopLeft.x,		closeTopLeft.y,		closeTopLeft.z,		color.r,	color.g,	color.b,	color.a,	0.25,	0.5,	(float)textureID },
@@ -170,7 +182,7 @@ void Renderer::PrepareCube(glm::vec3 size, glm::vec3 position, Quaternion q, glm
 	};
 
 	// Back		- All the far verts.
-	Quad back
+	back =
 	{
 		{
 			{ farTopRight.x,		farTopRight.y,		farTopRight.z,		color.r,	color.g,	color.b,	color.a,	0.5,	0.5,	(float)textureID },
@@ -186,7 +198,7 @@ void Renderer::PrepareCube(glm::vec3 size, glm::vec3 position, Quaternion q, glm
 	};
 
 	// Right		- Close left, top and bottom, and far left, top and bottom.		- The far verts will be treated as the quad's left, top and bottom.
-	Quad right
+	right =
 	{
 		{
 			{ farTopLeft.x,			farTopLeft.y,		farTopLeft.z,		color.r,	color.g,	color.b,	color.a,	0.5,	0.5,	(float)textureID },
@@ -201,7 +213,7 @@ void Renderer::PrepareCube(glm::vec3 size, glm::vec3 position, Quaternion q, glm
 	};
 
 	// Left	- Close right, top and bottom, and far right, top and bottom.	- The close verts will be treated as the quad's left, top and bottom.
-	Quad left
+	left =
 	{
 		{
 			{ closeTopRight.x,		closeTopRight.y,	closeTopRight.z,	color.r,	color.g,	color.b,	color.a,	0.25,	0.25,	(float)textureID },
@@ -216,7 +228,7 @@ void Renderer::PrepareCube(glm::vec3 size, glm::vec3 position, Quaternion q, glm
 	};
 
 	// Top		- Close top, left and right, and far top, left and right.		- The left verts, far and close, will be treated as the quad's left, top and bottom.
-	Quad top
+	top =
 	{
 		{
 			{ farTopLeft.x,			farTopLeft.y,		farTopLeft.z,		color.r,	color.g,	color.b,	color.a,	0.25,	0.5,	(float)textureID },
@@ -231,7 +243,7 @@ void Renderer::PrepareCube(glm::vec3 size, glm::vec3 position, Quaternion q, glm
 	};
 
 	// Bottom		- Close bottom, left and right, and far bottom, left and right.	- The right verts, far and close, will be treated as the quad's left, top and bottom.
-	Quad bottom
+	bottom =
 	{
 		{
 			{ closeBottomLeft.x,	closeBottomLeft.y,	closeBottomLeft.z,	color.r,	color.g,	color.b,	color.a,	0.75,	0.5,	(float)textureID },
@@ -244,6 +256,33 @@ void Renderer::PrepareCube(glm::vec3 size, glm::vec3 position, Quaternion q, glm
 			{ farBottomRight.x,		farBottomRight.y,	farBottomRight.z,	color.r,	color.g,	color.b,	color.a,	1.0,	0.25,	(float)textureID },
 		}
 	};
+}
+
+void RenderBuffer::PrepareCube(glm::vec3 size, glm::vec3 position, Quaternion q, glm::vec4 color, int textureID, uint8_t exposedFaces)
+{
+	Quad front, back, right, left, top, bottom;
+	CubeQuads(size, position, q, color, textureID, front, back, right, left, top, bottom);
+
+	float f = glm::length2(Game::main.cameraForward - Util::Rotate({ 0.0f, 0.0f, 1.0f }, q));
+	float b = glm::length2(Game::main.cameraForward - Util::Rotate({ 0.0f, 0.0f, -1.0f }, q));
+	float u = glm::length2(Game::main.cameraForward - Util::Rotate({ 0.0f, -1.0f, 0.0f }, q));
+	float d = glm::length2(Game::main.cameraForward - Util::Rotate({ 0.0f, 1.0f, 0.0f }, q));
+	float r = glm::length2(Game::main.cameraForward - Util::Rotate({ 1.0f, 0.0f, 0.0f }, q));
+	float l = glm::length2(Game::main.cameraForward - Util::Rotate({ -1.0f, 0.0f, 0.0f }, q));
+
+	float minDiff = 2.0f;
+
+	// Faces pressed against a resting neighbour can't be seen from anywhere.
+	// Each camera test above is against the inward normal, so the face's own is the negation.
+	if (exposedFaces != 0x3F)
+	{
+		if (!(exposedFaces & FaceBit(-Util::Rotate({ 0.0f, 0.0f, 1.0f }, q))))		f = 0.0f;
+		if (!(exposedFaces & FaceBit(-Util::Rotate({ 0.0f, 0.0f, -1.0f }, q))))	b = 0.0f;
+		if (!(exposedFaces & FaceBit(-Util::Rotate({ 0.0f, -1.0f, 0.0f }, q))))	u = 0.0f;
+		if (!(exposedFaces & FaceBit(-Util::Rotate({ 0.0f, 1.0f, 0.0f }, q))))		d = 0.0f;
+		if (!(exposedFaces & FaceBit(-Util::Rotate({ 1.0f, 0.0f, 0.0f }, q))))		r = 0.0f;
+		if (!(exposedFaces & FaceBit(-Util::Rotate({ -1.0f, 0.0f, 0.0f }, q))))	l = 0.0f;
+	}
 
 	if (f > minDiff) PrepareQuad(front,		textureID);
 	if (l > minDiff) PrepareQuad(left,		textureID);
@@ -260,27 +299,108 @@ void Renderer::PrepareCube(glm::vec3 size, glm::vec3 position, Quaternion q, glm
 	PrepareQuad(bottom, textureID);*/
 }
 
-void Renderer::PrepareQuad(Quad& input, int textureID)
+void RenderBuffer::CubeFaces(glm::vec3 size, Quaternion q, glm::vec4 color, int textureID, CubeFace faces[6])
+{
+	Quad quads[6];
+	CubeQuads(size, glm::vec3(0.0f, 0.0f, 0.0f), q, color, textureID, quads[0], quads[1], quads[2], quads[3], quads[4], quads[5]);
+
+	for (int i = 0; i < 6; i++)
+	{
+		const Vertex* corners[6] =
+		{
+			&quads[i].left.topLeft, &quads[i].left.bottomRight, &quads[i].left.bottomLeft,
+			&quads[i].right.topLeft, &quads[i].right.bottomRight, &quads[i].right.bottomLeft,
+		};
+
+		// The cube sits on the origin here, so the middle of the quad points the way the face does.
+		glm::vec3 middle = { 0.0f, 0.0f, 0.0f };
+		for (int j = 0; j < 6; j++)
+		{
+			middle += glm::vec3(corners[j]->x, corners[j]->y, corners[j]->z);
+		}
+
+		Face face = FaceOf(middle);
+
+		// The two world axes the face lies in, lower one first.
+		int axis = (face == Face::left || face == Face::right) ? 0 : (face == Face::top || face == Face::bottom) ? 1 : 2;
+		int a = axis == 0 ? 1 : 0;
+		int b = axis == 2 ? 1 : 2;
+
+		glm::vec2 uv[2][2];
+		for (int j = 0; j < 6; j++)
+		{
+			glm::vec3 p = { corners[j]->x, corners[j]->y, corners[j]->z };
+			uv[p[a] > 0.0f][p[b] > 0.0f] = { corners[j]->s, corners[j]->t };
+		}
+
+		faces[(int)face] = { textureID, color, size, uv[0][0], uv[1][0] - uv[0][0], uv[0][1] - uv[0][0] };
+	}
+}
+
+void StaticMesh::Begin()
+{
+	pending.clear();
+}
+
+void StaticMesh::AddFace(const CubeFace& face, glm::vec3 corner, glm::vec3 spanA, glm::vec3 spanB, int tilesA, int tilesB)
+{
+	glm::vec3 positions[4] = { corner, corner + spanA, corner + spanA + spanB, corner + spanB };
+	float tiles[4][2] = { { 0.0f, 0.0f }, { (float)tilesA, 0.0f }, { (float)tilesA, (float)tilesB }, { 0.0f, (float)tilesB } };
+
+	StaticVertex corners[4];
+	for (int i = 0; i < 4; i++)
+	{
+		corners[i] =
+		{
+			positions[i].x,	positions[i].y,	positions[i].z,
+			face.color.r,	face.color.g,	face.color.b,	face.color.a,
+			tiles[i][0],	tiles[i][1],
+			face.uv.x,		face.uv.y,		face.uvA.x,		face.uvA.y,		face.uvB.x,		face.uvB.y
+		};
+	}
+
+	static const int order[6] = { 0, 1, 2, 0, 2, 3 };
+	for (int i = 0; i < 6; i++)
+	{
+		pending.push_back({ face.textureID, corners[order[i]] });
+	}
+}
+
+void StaticMesh::End()
+{
+	std::stable_sort(pending.begin(), pending.end(), [](const std::pair<int, StaticVertex>& lhs, const std::pair<int, StaticVertex>& rhs)
+	{
+		return lhs.first < rhs.first;
+	});
+
+	vertices.clear();
+	ranges.clear();
+
+	for (int i = 0; i < pending.size(); i++)
+	{
+		if (ranges.size() == 0 || ranges.back().textureID != pending[i].first)
+		{
+			ranges.push_back({ pending[i].first, i, 0 });
+		}
+
+		ranges.back().count++;
+		vertices.push_back(pending[i].second);
+	}
+
+	pending.clear();
+	changed = true;
+}
+
+void RenderBuffer::PrepareQuad(Quad& input, int textureID)
 {
-	Bundle bundle = DetermineBatch(textureID);
-	Batch& batch = batches[bundle.batch];
-
-	// Triangle& t1 = batch.buffer[batch.index];
-	input.left.topLeft.texture = bundle.location;
-	input.left.bottomLeft.texture = bundle.location;
-	input.left.bottomRight.texture = bundle.location;
-	batch.buffer[batch.index] = input.left;
-	batch.index++;
-
-	// Triangle& t2 = batch.buffer[batch.index];
-	input.right.topLeft.texture = bundle.location;
-	input.right.bottomLeft.texture = bundle.location;
-	input.right.bottomRight.texture = bundle.location;
-	batch.buffer[batch.index] = input.right;
-	batch.index++;
+	triangles.push_back(input.left);
+	textureIDs.push_back(textureID);
+
+	triangles.push_back(input.right);
+	textureIDs.push_back(textureID);
 }
 
-void Renderer::PrepareQuad(glm::vec2 size, glm::vec3 position, Quaternion q, glm::vec4 color, int textureID)
+void RenderBuffer::PrepareQuad(glm::vec2 size, glm::vec3 position, Quaternion q, glm::vec4 color, int textureID)
 {
 	/*Batch& batch = DetermineBatch(textureID);
 	Quad& quad = batch.buffer[batch.index];
@@ -288,7 +408,7 @@ void Renderer::PrepareQuad(glm::vec2 size, glm::vec3 position, Quaternion q, glm
 
 }
 
-void Renderer::PrepareQuad(glm::vec2 size, glm::vec3 position, Quaternion q, glm::vec4 color, int animationID, int cellX, int cellY, int cols, int rows, bool flippedX, bool flippedY)
+void RenderBuffer::PrepareQuad(glm::vec2 size, glm::vec3 position, Quaternion q, glm::vec4 color, int animationID, int cellX, int cellY, int cols, int rows, bool flippedX, bool flippedY)
 {
 	glm::vec3 topRight		= Util::RotateRelative(	position,	position + glm::vec3(	size.x / 2.0f,	size.y / 2.0f,	0.0f),	q);//  * Game::main.zoom;
 	glm::vec3 bottomRight	= Util::RotateRelative(	position,	position + glm::vec3(	size.x / 2.0f,	-size.y / 2.0f, 0.0f),	q);//  * Game::main.zoom;
@@ -341,8 +461,116 @@ void Renderer::PrepareQuad(glm::vec2 size, glm::vec3 position, Quaternion q, glm
 	PrepareQuad(quad, animationID);
 }
 
+void RenderBuffer::Clear()
+{
+	triangles.clear();
+	textureIDs.clear();
+}
+
+void Renderer::Submit(const RenderBuffer& buffer)
+{
+	// Runs of the same texture are the norm, so only look the batch up again when the texture changes or the batch fills.
+	Bundle bundle = { 0, 0.0f };
+	int lastTextureID = -1;
+
+	for (int i = 0; i < buffer.triangles.size(); i++)
+	{
+		int textureID = buffer.textureIDs[i];
+
+		if (textureID != lastTextureID || batches[bundle.batch].index + 2 >= Batch::MAX_TRIS)
+		{
+			bundle = DetermineBatch(textureID);
+			lastTextureID = textureID;
+		}
+
+		Batch& batch = batches[bundle.batch];
+
+		Triangle t = buffer.triangles[i];
+		t.topLeft.texture = bundle.location;
+		t.bottomLeft.texture = bundle.location;
+		t.bottomRight.texture = bundle.location;
+
+		batch.buffer[batch.index] = t;
+		batch.index++;
+	}
+}
+
+void Renderer::Submit(StaticMesh& mesh)
+{
+	if (mesh.changed) Upload(mesh);
+
+	if (mesh.ranges.size() > 0) staticMeshes.push_back(&mesh);
+}
+
+void Renderer::Upload(StaticMesh& mesh)
+{
+	if (mesh.VAO == 0)
+	{
+		glGenVertexArrays(1, &mesh.VAO);
+		glBindVertexArray(mesh.VAO);
+
+		glGenBuffers(1, &mesh.VBO);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+
+		// Coordinates
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), (void*)offsetof(StaticVertex, x));
+		glEnableVertexAttribArray(0);
+
+		// Color
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), (void*)offsetof(StaticVertex, r));
+		glEnableVertexAttribArray(1);
+
+		// Position across the face, in cells
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), (void*)offsetof(StaticVertex, tileA));
+		glEnableVertexAttribArray(2);
+
+		// Texture mapping: the corner, then the step per cell along each axis
+		glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), (void*)offsetof(StaticVertex, s));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), (void*)offsetof(StaticVertex, sA));
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), (void*)offsetof(StaticVertex, sB));
+		glEnableVertexAttribArray(5);
+	}
+	else
+	{
+		glBindVertexArray(mesh.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+	}
+
+	glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(StaticVertex), mesh.vertices.data(), GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// The GPU has its own copy now.
+	std::vector<StaticVertex>().swap(mesh.vertices);
+	mesh.changed = false;
+}
+
 void Renderer::Display()
 {
+	if (staticMeshes.size() > 0)
+	{
+		staticShader.Use();
+		staticShader.SetMatrix("MVP", Game::main.projection * Game::main.view);
+
+		glActiveTexture(GL_TEXTURE0);
+
+		for (int i = 0; i < staticMeshes.size(); i++)
+		{
+			glBindVertexArray(staticMeshes[i]->VAO);
+
+			for (const StaticMesh::Range& range : staticMeshes[i]->ranges)
+			{
+				glBindTexture(GL_TEXTURE_2D, textureIDs[range.textureID - 1]);
+				glDrawArrays(GL_TRIANGLES, range.first, range.count);
+			}
+		}
+
+		glBindVertexArray(0);
+	}
+
 	shader.Use();
 	shader.SetMatrix("MVP", Game::main.projection * Game::main.view);
 
@@ -382,6 +610,8 @@ void Renderer::ResetBuffers()
 	texturesUsed.clear();
 	texturesUsed.push_back(whiteTextureID);
 
+	staticMeshes.clear();
+
 	for (Batch& batch : batches)
 	{
 		batch.index = 0;
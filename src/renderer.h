@@ -40,6 +40,81 @@ struct Quad
 	Triangle right;
 };
 
+// How one face of a resting cube looks: which part of its texture lands on it and which way round.
+// uvA and uvB are how far the texture coordinates move across one cell along the lower and
+// higher of the two world axes the face lies in, so faces that compare equal can be merged.
+struct CubeFace
+{
+	int textureID;
+	glm::vec4 color;
+	glm::vec3 size;
+
+	glm::vec2 uv;
+	glm::vec2 uvA;
+	glm::vec2 uvB;
+
+	bool operator==(const CubeFace& rhs) const
+	{
+		return textureID == rhs.textureID && color == rhs.color && size == rhs.size && uv == rhs.uv && uvA == rhs.uvA && uvB == rhs.uvB;
+	}
+};
+
+// Static meshes tile the texture across merged faces in the shader, so each vertex carries its
+// position in cells across the face along with the face's texture mapping.
+struct StaticVertex
+{
+	float x;
+	float y;
+	float z;
+
+	float r;
+	float g;
+	float b;
+	float a;
+
+	float tileA;
+	float tileB;
+
+	float s;
+	float t;
+	float sA;
+	float tA;
+	float sB;
+	float tB;
+};
+
+// Geometry that stays put from frame to frame (a chunk's resting cubes, say).
+// It is built on any thread, uploaded by Renderer::Submit the next time it is submitted after
+// a change, and drawn from its own buffer every frame after that without being touched again.
+struct StaticMesh
+{
+	struct Range
+	{
+		int textureID;
+		int first;
+		int count;
+	};
+
+	std::vector<StaticVertex> vertices;	// Only kept until the upload.
+	std::vector<Range> ranges;			// One per texture.
+
+	GLuint VAO = 0;
+	GLuint VBO = 0;
+
+	bool changed = false;
+
+	void Begin();
+
+	// A rectangle from corner to corner + spanA + spanB, with the face's texture repeated tilesA by tilesB times.
+	void AddFace(const CubeFace& face, glm::vec3 corner, glm::vec3 spanA, glm::vec3 spanB, int tilesA, int tilesB);
+
+	// Groups what was added by texture and flags the mesh for upload.
+	void End();
+
+private:
+	std::vector<std::pair<int, StaticVertex>> pending;
+};
+
 struct Batch
 {
 	static constexpr int MAX_TRIS = 20000;
@@ -48,6 +123,28 @@ struct Batch
 	int index = 0;
 };
 
+// Geometry queued up by one system, or one chunk of a system, during the frame.
+// Filling a buffer touches nothing shared, so it can happen on any thread;
+// Renderer::Submit folds the buffers into the batches afterwards, in a fixed order.
+struct RenderBuffer
+{
+	std::vector<Triangle> triangles;
+	std::vector<int> textureIDs;	// One per triangle.
+
+	// exposedFaces has a bit per Face, in cube space; faces without one are left out.
+	void PrepareCube(glm::vec3 size, glm::vec3 position, Quaternion q, glm::vec4 color, int textureID, uint8_t exposedFaces = 0x3F);
+	void PrepareModel(glm::vec3 size, glm::vec3 position, Quaternion q, glm::vec4 color, Model* model);
+
+	void PrepareQuad(Quad& input, int textureID);
+
+	// The six faces of a cube with rotation q, indexed by the cube-space Face each one ends up on.
+	static void CubeFaces(glm::vec3 size, Quaternion q, glm::vec4 color, int textureID, CubeFace faces[6]);
+	void PrepareQuad(glm::vec2 size, glm::vec3 position, Quaternion q, glm::vec4 color, int textureID);
+	void PrepareQuad(glm::vec2 size, glm::vec3 position, Quaternion q, glm::vec4 color, int animationID, int cellX, int cellY, int cols, int rows, bool flippedX, bool flippedY);
+
+	void Clear();
+};
+
 struct Bundle
 {
 	int batch;
@@ -70,12 +167,8 @@ public:
 
 	Renderer(GLuint whiteTexture);
 
-	void PrepareCube(glm::vec3 size, glm::vec3 position, Quaternion q, glm::vec4 color, int textureID);
-	void PrepareModel(glm::vec3 size, glm::vec3 position, Quaternion q, glm::vec4 color, Model* model);
-
-	void PrepareQuad(Quad& input, int textureID);
-	void PrepareQuad(glm::vec2 size, glm::vec3 position, Quaternion q, glm::vec4 color, int textureID);
-	void PrepareQuad(glm::vec2 size, glm::vec3 position, Quaternion q, glm::vec4 color, int animationID, int cellX, int cellY, int cols, int rows, bool flippedX, bool flippedY);
+	void Submit(const RenderBuffer& buffer);
+	void Submit(StaticMesh& mesh);
 
 	Bundle DetermineBatch(int textureID);
 
@@ -84,8 +177,12 @@ public:
 
 private:
 	std::vector<Batch> batches;
+	std::vector<StaticMesh*> staticMeshes;	// Submitted this frame.
 	
 	Shader shader;
+	Shader staticShader;
+
+	void Upload(StaticMesh& mesh);
 
 	void Flush(const Batch& batch);
 };
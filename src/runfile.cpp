@@ -0,0 +1,126 @@
+#include "runfile.h"
+
+#include <algorithm>
+#include <cstring>
+
+#pragma region Writer
+
+bool RunWriter::Open(const std::string& path)
+{
+	file.open(path, std::ios::binary | std::ios::trunc);
+	last.clear();
+	count = 0;
+
+	return file.good();
+}
+
+void RunWriter::Write(const uint8_t* data, uint32_t length)
+{
+	if (count > 0 && Compare(data, length, last.data(), (uint32_t)last.size()) == 0) return;
+
+	uint32_t shared = 0;
+	uint32_t most = std::min(length, (uint32_t)last.size());
+
+	while (shared < most && data[shared] == last[shared]) shared++;
+
+	PutVarint(shared);
+	PutVarint(length - shared);
+	file.write((const char*)data + shared, length - shared);
+
+	last.assign(data, data + length);
+	count++;
+}
+
+bool RunWriter::Close()
+{
+	file.close();
+	return !file.fail();
+}
+
+int RunWriter::Compare(const uint8_t* a, uint32_t aLength, const uint8_t* b, uint32_t bLength)
+{
+	int order = memcmp(a, b, std::min(aLength, bLength));
+	if (order != 0) return order;
+
+	return aLength < bLength ? -1 : aLength > bLength ? 1 : 0;
+}
+
+void RunWriter::PutVarint(uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		file.put((char)(value | 0x80));
+		value >>= 7;
+	}
+
+	file.put((char)value);
+}
+
+#pragma endregion
+
+#pragma region Reader
+
+bool RunReader::Open(const std::string& path)
+{
+	file.open(path, std::ios::binary);
+	current.clear();
+	failed = !file.good();
+
+	return !failed;
+}
+
+bool RunReader::Next()
+{
+	uint64_t shared;
+
+	// Running out here, between states, is the one place the file is allowed to end.
+	if (!GetVarint(shared))
+	{
+		failed = failed || !file.eof();
+		return false;
+	}
+
+	uint64_t rest;
+
+	if (shared > current.size() || !GetVarint(rest))
+	{
+		failed = true;
+		return false;
+	}
+
+	current.resize(shared + rest);
+	file.read((char*)current.data() + shared, rest);
+
+	if (file.gcount() != (std::streamsize)rest)
+	{
+		failed = true;
+		return false;
+	}
+
+	return true;
+}
+
+bool RunReader::GetVarint(uint64_t& value)
+{
+	value = 0;
+
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		int byte = file.get();
+
+		if (byte == std::char_traits<char>::eof())
+		{
+			// A varint cut off partway is a bad file, not the end of a good one.
+			if (shift > 0) failed = true;
+			return false;
+		}
+
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) return true;
+	}
+
+	failed = true;
+	return false;
+}
+
+#pragma endregion
@@ -0,0 +1,58 @@
+#ifndef RUNFILE_H
+#define RUNFILE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Files of packed states in sorted order, for searches too big to keep in memory. Neighbours in a
+// sorted run mostly start out the same, so each state is written as how many bytes it shares with
+// the one before it, how many bytes follow, and then those bytes.
+class RunWriter
+{
+public:
+	bool Open(const std::string& path);
+
+	// States have to come in order. A state the same as the last one is dropped.
+	void Write(const uint8_t* data, uint32_t length);
+
+	// False if anything couldn't be written.
+	bool Close();
+
+	uint64_t Count() const { return count; }
+
+	// Byte by byte, with a state that another starts with coming first.
+	static int Compare(const uint8_t* a, uint32_t aLength, const uint8_t* b, uint32_t bLength);
+
+private:
+	std::ofstream file;
+	std::vector<uint8_t> last;
+	uint64_t count = 0;
+
+	void PutVarint(uint64_t value);
+};
+
+class RunReader
+{
+public:
+	bool Open(const std::string& path);
+
+	// Moves on to the next state; false once there are none left, or the file can't be read.
+	bool Next();
+
+	const uint8_t* Data() const { return current.data(); }
+	uint32_t Length() const { return (uint32_t)current.size(); }
+
+	// Whether Next stopped because of a bad file rather than at the end of a good one.
+	bool Failed() const { return failed; }
+
+private:
+	std::ifstream file;
+	std::vector<uint8_t> current;
+	bool failed = false;
+
+	bool GetVarint(uint64_t& value);
+};
+
+#endif
@@ -0,0 +1,467 @@
+// solve.cpp
+//
+// Runs PuzzleSolver on a level from the command line, so levels can be checked without the game.
+//
+//   unending_solve <level> [maxMoves] [--disk] [--symmetry]
+//   unending_solve --check
+//
+// A level file has one thing to a line, and # starts a comment:
+//
+//   cube x y z
+//   actor x y z face	the cube the actor starts on, and the face they're standing on
+//   goal x y z face	the cube the actor has to end up on, and the face they have to be on
+//
+// Faces are front, back, left, right, top or bottom.
+//
+// Exits with 0 if it finds a solution and 1 if it doesn't, or 3 if that was with --symmetry, which
+// can miss them; 2 means the arguments or the level are no good.
+//
+// --check solves a few small puzzles whose shortest solutions were worked out by hand, in memory and
+// on disk, with and without reduceSymmetry, and fails if any answer comes out differently or a
+// solution doesn't play back. One level is symmetric, so reduceSymmetry has to reach fewer states on it.
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "solver.h"
+#include "threadpool.h"
+
+struct Level
+{
+	std::vector<glm::ivec3> cubes;
+
+	glm::ivec3 actorCell = glm::ivec3(0);
+	Face actorFace = Face::top;
+
+	glm::ivec3 goalCell = glm::ivec3(0);
+	Face goalFace = Face::top;
+};
+
+static const char* faceNames[6] = { "front", "back", "left", "right", "top", "bottom" };
+
+static bool ParseFace(const std::string& name, Face& face)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (name == faceNames[i])
+		{
+			face = (Face)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool LoadLevel(const char* path, Level& level)
+{
+	std::ifstream file(path);
+
+	if (!file.is_open())
+	{
+		std::cout << "Couldn't open " << path << '\n';
+		return false;
+	}
+
+	std::string line;
+	bool hasActor = false, hasGoal = false;
+	std::unordered_set<uint64_t> cells;
+
+	for (int number = 1; std::getline(file, line); number++)
+	{
+		line = line.substr(0, line.find('#'));
+
+		std::istringstream words(line);
+		std::string kind, face;
+		glm::ivec3 cell;
+
+		if (!(words >> kind)) continue;
+
+		bool ok = (bool)(words >> cell.x >> cell.y >> cell.z);
+
+		if (ok && kind == "cube")
+		{
+			if (!cells.insert(PuzzleState::PackCell(cell)).second)
+			{
+				std::cout << path << ":" << number << ": there's already a cube at " << cell.x << " " << cell.y << " " << cell.z << '\n';
+				return false;
+			}
+
+			level.cubes.push_back(cell);
+		}
+		else if (ok && kind == "actor" && words >> face && ParseFace(face, level.actorFace))
+		{
+			level.actorCell = cell;
+			hasActor = true;
+		}
+		else if (ok && kind == "goal" && words >> face && ParseFace(face, level.goalFace))
+		{
+			level.goalCell = cell;
+			hasGoal = true;
+		}
+		else
+		{
+			std::cout << path << ":" << number << ": can't read \"" << line << "\"\n";
+			return false;
+		}
+	}
+
+	if (!hasActor || !hasGoal)
+	{
+		std::cout << path << " needs an actor line and a goal line\n";
+		return false;
+	}
+
+	// The actor stands on a cube, and the goal is a cube to stand on.
+	if (cells.count(PuzzleState::PackCell(level.actorCell)) == 0)
+	{
+		std::cout << path << ": the actor's cell, " << level.actorCell.x << " " << level.actorCell.y << " " << level.actorCell.z << ", has no cube\n";
+		return false;
+	}
+
+	if (cells.count(PuzzleState::PackCell(level.goalCell)) == 0)
+	{
+		std::cout << path << ": the goal's cell, " << level.goalCell.x << " " << level.goalCell.y << " " << level.goalCell.z << ", has no cube\n";
+		return false;
+	}
+
+	return true;
+}
+
+// The cubes get handles in the order they're listed.
+static void PlaceLevel(const Level& level, PuzzleSim& sim, SimActor& actor)
+{
+	for (int i = 0; i < level.cubes.size(); i++)
+	{
+		sim.Place(level.cubes[i].x, level.cubes[i].y, level.cubes[i].z, EntityHandle::Make(i + 1, 1));
+	}
+
+	actor = { EntityHandle(), sim.grid.Get(level.actorCell.x, level.actorCell.y, level.actorCell.z), level.actorCell, level.actorFace };
+}
+
+static PuzzleState CaptureLevel(const Level& level)
+{
+	PuzzleSim sim;
+	SimActor actor;
+	PlaceLevel(level, sim, actor);
+
+	return PuzzleState::Capture(sim.grid, actor, level.goalCell);
+}
+
+// Plays a solution back on a fresh sim, and checks that it ends with the actor on the goal cube's goal face.
+static bool Replay(const Level& level, const std::vector<SolverMove>& moves)
+{
+	PuzzleSim sim;
+	SimActor actor;
+	PlaceLevel(level, sim, actor);
+
+	EntityHandle goal = sim.grid.Get(level.goalCell.x, level.goalCell.y, level.goalCell.z);
+
+	for (int i = 0; i < moves.size(); i++)
+	{
+		Face direction = Util::GetAbsoluteFace(actor.face, moves[i].direction);
+		bool moved;
+
+		if (moves[i].roll)
+		{
+			moved = sim.Roll(actor, direction);
+		}
+		else
+		{
+			glm::vec3 step = Util::GetRelativeUp(direction);
+			moved = sim.Walk(actor, (int)step.x, (int)step.y, (int)step.z);
+		}
+
+		if (!moved) return false;
+	}
+
+	return actor.cube == goal && actor.face == level.goalFace;
+}
+
+static void Print(const SolveResult& result, int maxMoves)
+{
+	// The directions as the player would say them; Face::back is forward, as in InputSystem.
+	static const char* directions[6] = { "back", "forward", "left", "right", "up", "down" };
+
+	if (result.solved)
+	{
+		std::cout << "Solved in " << result.moves.size() << " moves" << (result.inexact ? " (maybe not the fewest, with --symmetry)" : "") << ":";
+
+		for (int i = 0; i < result.moves.size(); i++)
+		{
+			std::cout << (i == 0 ? " " : ", ") << (result.moves[i].roll ? "roll " : "walk ") << directions[(int)result.moves[i].direction];
+		}
+
+		std::cout << '\n';
+	}
+	else if (result.outOfMemory)
+	{
+		std::cout << "Ran out of memory before finding a solution\n";
+	}
+	else if (result.diskError)
+	{
+		std::cout << "Couldn't write or read the search's files\n";
+	}
+	else if (result.inexact)
+	{
+		std::cout << "Found no solution in " << maxMoves << " moves or fewer, but --symmetry can miss them; try again without it to be sure\n";
+	}
+	else
+	{
+		std::cout << "No solution in " << maxMoves << " moves or fewer\n";
+	}
+
+	std::cout << result.expanded << " states expanded, " << result.generated << " reached, " << result.seconds << "s, " << (uint64_t)result.NodesPerSecond() << " nodes/s\n";
+}
+
+#pragma region Checks
+
+struct Check
+{
+	const char* name;
+	Level level;
+	int maxMoves;
+	int expected;			// -1 for none.
+	uint64_t minStates = 0;	// For the searches that are exact, at least this many states should be reached (and on disk, spilled twice a depth).
+	bool symmetric = false;	// reduceSymmetry should reach fewer states than the exact search.
+};
+
+static std::vector<Check> MakeChecks()
+{
+	std::vector<Check> checks;
+
+	// Already standing on the goal.
+	{
+		Level level;
+		level.cubes = { { 0, 0, 0 } };
+		level.goalFace = Face::top;
+
+		checks.push_back({ "already there", level, 4, 0 });
+	}
+
+	// A row of three: two walks along it. A roll only ever moves the actor's own cube, and no landing
+	// spot is two cells straight along the row, so one move can't do it.
+	{
+		Level level;
+		level.cubes = { { 0, 0, 0 }, { 1, 0, 0 }, { 2, 0, 0 } };
+		level.goalCell = { 2, 0, 0 };
+
+		checks.push_back({ "walk the row", level, 6, 2 });
+	}
+
+	// A cube on a floor cube, to be stood on from underneath. Walking never changes face, and a half roll
+	// over any edge of the floor cube flips the actor over, so it's one roll, whichever way.
+	{
+		Level level;
+		level.cubes = { { 0, -1, 0 }, { 0, 0, 0 } };
+		level.goalFace = Face::bottom;
+
+		checks.push_back({ "flip over", level, 6, 1 });
+	}
+
+	// Two cubes apart, with nothing between them: nothing to walk onto and nothing to roll against.
+	{
+		Level level;
+		level.cubes = { { 0, 0, 0 }, { 5, 0, 0 } };
+		level.goalCell = { 5, 0, 0 };
+
+		checks.push_back({ "out of reach", level, 6, -1 });
+	}
+
+	// Standing on A, with B stuck to its right and a wall F, on a step S, to its left. Pushing right finds
+	// nothing below A, so F is the fulcrum and A swings down past S's edge, carrying B with it: A ends up
+	// just below where it was and B below that, and the actor is left on A's right face.
+	//
+	//   F A B			F
+	//   S				S A
+	//					  B
+	//
+	// Then a walk down onto B. Only a roll changes face, the only roll that leaves the actor on a right face
+	// is that one, and rolls never take the actor off its own cube, so there's no doing it in one.
+	{
+		Level level;
+		level.cubes = { { 0, 0, 0 }, { -1, -1, 0 }, { -1, 0, 0 }, { 1, 0, 0 } };
+		level.goalCell = { 1, 0, 0 };
+		level.goalFace = Face::right;
+
+		checks.push_back({ "swing a structure", level, 6, 2 });
+	}
+
+	// The same swing with a longer arm, A B C, whose end would land on O, so the roll stops partway. Cells
+	// are whole steps down from A's, rounded towards zero, so A, swinging down by less than a cell, is
+	// still in its own cell, and the actor on its right face can walk straight across onto G, behind it.
+	// Had the swing gone all the way, A would have left G behind and this would take more than two.
+	{
+		Level level;
+		level.cubes = { { 0, 0, 0 }, { -1, -1, 0 }, { -1, 0, 0 }, { 1, 0, 0 }, { 2, 0, 0 }, { 0, -3, 0 }, { 0, 0, 1 } };
+		level.goalCell = { 0, 0, 1 };
+		level.goalFace = Face::right;
+
+		checks.push_back({ "swing cut short", level, 6, 2 });
+	}
+
+	// A plus of floor cubes with one more standing on its middle, to be stood on from underneath. Turned a
+	// quarter about the up axis, or mirrored across either arm, it's the same level with the same goal, so
+	// states come in sets of up to 8 that reduceSymmetry folds into one. The move count is the one place
+	// here not worked out by hand: it's what the exact searches find, and the folded one has to agree.
+	{
+		Level level;
+		level.cubes = { { 0, -1, 0 }, { 1, -1, 0 }, { -1, -1, 0 }, { 0, -1, 1 }, { 0, -1, -1 }, { 0, 0, 0 } };
+		level.goalFace = Face::bottom;
+
+		checks.push_back({ "symmetric", level, 8, 8, 100, true });
+	}
+
+	// A 5 by 5 floor with every third cube on it built up a level, for lots of little rolls and walks: about
+	// 1,300 states within 10 moves, nearly 600 of them at the last depth, so every depth past the first few
+	// is expanded in several chunks at once, all going into the same table. The goal is 1,000 cells away.
+	// Only the actor's structure ever moves, each cube by at most twice the structure's size, so in 10 moves
+	// nothing gets anywhere near it.
+	{
+		Level level;
+
+		for (int x = 0; x < 5; x++)
+		{
+			for (int z = 0; z < 5; z++)
+			{
+				level.cubes.push_back({ x, -1, z });
+				if ((x + 2 * z) % 3 == 0 || (x == 2 && z == 2)) level.cubes.push_back({ x, 0, z });
+			}
+		}
+
+		level.cubes.push_back({ 1000, 0, 0 });
+		level.actorCell = { 2, 0, 2 };
+		level.goalCell = { 1000, 0, 0 };
+
+		checks.push_back({ "wide and out of reach", level, 10, -1, 1000 });
+	}
+
+	return checks;
+}
+
+static int RunChecks()
+{
+	std::vector<Check> checks = MakeChecks();
+	int failures = 0;
+
+	for (int i = 0; i < checks.size(); i++)
+	{
+		const Check& check = checks[i];
+		PuzzleState start = CaptureLevel(check.level);
+		uint64_t exactStates = 0;
+
+		for (int mode = 0; mode < 3; mode++)
+		{
+			static const char* modes[3] = { "memory", "memory, symmetry", "disk" };
+
+			PuzzleSolver solver;
+			solver.reduceSymmetry = mode == 1;
+
+			// A few states' worth, so that the bigger levels spill to runs several times a depth, and the runs
+			// have states in common for the merge to throw out.
+			solver.disk.memoryBytes = 256;
+
+			SolveResult result = mode == 2 ?
+				solver.SolveOnDisk(start, check.level.goalFace, check.maxMoves) :
+				solver.Solve(start, check.level.goalFace, check.maxMoves);
+
+			int moves = result.solved ? (int)result.moves.size() : -1;
+			bool ok = moves == check.expected && !result.diskError && !result.outOfMemory && (!result.solved || Replay(check.level, result.moves));
+			if (!solver.reduceSymmetry && result.generated < check.minStates) ok = false;
+			if (result.inexact != solver.reduceSymmetry) ok = false;
+
+			if (mode == 0) exactStates = result.generated;
+			if (mode == 1 && check.symmetric && result.generated >= exactStates) ok = false;
+
+			// Searched to the end, both exact searches reach every state there is to reach. (One that's solved
+			// stops partway through a depth, at a point that depends on the order it goes in.)
+			if (mode == 2 && !result.solved && result.generated != exactStates) ok = false;
+			if (mode == 2 && check.minStates > 0 && result.spills < 2 * check.maxMoves) ok = false;
+
+			std::cout << (ok ? "ok     " : "FAILED ") << check.name << " (" << modes[mode] << "): ";
+			if (result.solved) std::cout << moves << " moves";
+			else std::cout << "no solution";
+			std::cout << ", expected ";
+			if (check.expected >= 0) std::cout << check.expected << " moves";
+			else std::cout << "no solution";
+			std::cout << " (" << result.generated << " states";
+			if (mode == 2) std::cout << ", " << result.spills << " spills";
+			std::cout << ")\n";
+
+			if (!ok) failures++;
+		}
+	}
+
+	return failures == 0 ? 0 : 1;
+}
+
+#pragma endregion
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: unending_solve <level> [maxMoves] [--disk] [--symmetry]\n";
+		std::cout << "       unending_solve --check\n";
+		return 2;
+	}
+
+	bool check = std::string(argv[1]) == "--check";
+
+	Level level;
+	int maxMoves = 30;
+	bool onDisk = false;
+
+	PuzzleSolver solver;
+
+	// Anything that isn't a flag has to be the move limit, so that a mistyped flag doesn't quietly become one.
+	for (int i = 2; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		char* end;
+		long number = std::strtol(argv[i], &end, 10);
+
+		if (arg == "--disk") onDisk = true;
+		else if (arg == "--symmetry") solver.reduceSymmetry = true;
+		else if (!check && arg.size() > 0 && *end == '\0' && number >= 0 && number <= 1000) maxMoves = (int)number;
+		else
+		{
+			std::cout << "Don't know what \"" << arg << "\" means\n";
+			return 2;
+		}
+	}
+
+	if (check && argc > 2)
+	{
+		std::cout << "--check takes nothing else\n";
+		return 2;
+	}
+
+	if (!check && !LoadLevel(argv[1], level)) return 2;
+
+	ThreadPool::main.Start((int)std::thread::hardware_concurrency() - 1);
+
+	int status;
+
+	if (check)
+	{
+		status = RunChecks();
+	}
+	else
+	{
+		PuzzleState start = CaptureLevel(level);
+		SolveResult result = onDisk ? solver.SolveOnDisk(start, level.goalFace, maxMoves) : solver.Solve(start, level.goalFace, maxMoves);
+
+		Print(result, maxMoves);
+		status = result.solved ? 0 : result.inexact && !result.outOfMemory ? 3 : 1;
+	}
+
+	ThreadPool::main.Stop();
+	return status;
+}
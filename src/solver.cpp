@@ -0,0 +1,979 @@
+#include "solver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <queue>
+#include <tuple>
+
+#include "runfile.h"
+#include "threadpool.h"
+
+#pragma region Puzzle State
+
+uint64_t PuzzleState::PackCell(glm::ivec3 cell)
+{
+	const uint64_t mask = (1ull << 21) - 1;
+	const int bias = 1 << 20;
+
+	return ((uint64_t)(cell.z + bias) & mask) << 42 | ((uint64_t)(cell.y + bias) & mask) << 21 | ((uint64_t)(cell.x + bias) & mask);
+}
+
+glm::ivec3 PuzzleState::UnpackCell(uint64_t packed)
+{
+	const uint64_t mask = (1ull << 21) - 1;
+	const int bias = 1 << 20;
+
+	return glm::ivec3((int)(packed & mask) - bias, (int)((packed >> 21) & mask) - bias, (int)((packed >> 42) & mask) - bias);
+}
+
+PuzzleState PuzzleState::Capture(const VoxelGrid& grid, const SimActor& actor, glm::ivec3 goalCell)
+{
+	PuzzleState state;
+	state.actorCell = actor.cell;
+	state.face = actor.face;
+	state.goalCell = goalCell;
+
+	std::vector<VoxelGrid::Chunk*> chunks;
+	grid.CollectChunks(chunks);
+
+	for (int i = 0; i < chunks.size(); i++)
+	{
+		const VoxelGrid::Chunk& chunk = *chunks[i];
+		glm::ivec3 origin = glm::ivec3(chunk.cx, chunk.cy, chunk.cz) * VoxelGrid::chunkSize;
+
+		for (int r = 0; r < VoxelGrid::chunkRows; r++)
+		{
+			for (int lx = 0; lx < VoxelGrid::chunkSize; lx++)
+			{
+				if (((chunk.occupied[r] >> lx) & 1) == 0) continue;
+
+				state.cubes.push_back(PackCell(origin + glm::ivec3(lx, r & VoxelGrid::chunkMask, r >> VoxelGrid::chunkBits)));
+			}
+		}
+	}
+
+	std::sort(state.cubes.begin(), state.cubes.end());
+	state.Rehash();
+
+	return state;
+}
+
+void PuzzleState::Rehash()
+{
+	hash = PuzzleSim::ActorKey(actorCell, face);
+	hash ^= PuzzleSim::CellKey(goalCell, 0) ^ PuzzleSim::CellKey(goalCell, goalType);
+
+	for (int i = 0; i < cubes.size(); i++)
+	{
+		hash ^= PuzzleSim::CellKey(UnpackCell(cubes[i]), 0);
+	}
+}
+
+// Unsigned LEB128: seven bits a byte, low bits first, the top bit set on all but the last.
+static void PutVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+
+	out.push_back((uint8_t)value);
+}
+
+// Zigzagged, so that small negative numbers stay short too.
+static void PutSigned(std::vector<uint8_t>& out, int value)
+{
+	PutVarint(out, ((uint64_t)(uint32_t)value << 1) ^ (uint64_t)(int64_t)(value >> 31));
+}
+
+static uint64_t GetVarint(const uint8_t*& data)
+{
+	uint64_t value = 0;
+
+	for (int shift = 0;; shift += 7)
+	{
+		uint8_t byte = *data++;
+		value |= (uint64_t)(byte & 0x7f) << shift;
+
+		if ((byte & 0x80) == 0) return value;
+	}
+}
+
+static int GetSigned(const uint8_t*& data)
+{
+	uint32_t value = (uint32_t)GetVarint(data);
+	return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+void PuzzleState::Pack(std::vector<uint8_t>& out) const
+{
+	out.clear();
+	out.push_back((uint8_t)face);
+	PutVarint(out, cubes.size());
+
+	glm::ivec3 low(0);
+	glm::ivec3 size(0);
+
+	if (cubes.size() > 0)
+	{
+		low = UnpackCell(cubes[0]);
+		glm::ivec3 high = low;
+
+		for (int i = 1; i < cubes.size(); i++)
+		{
+			glm::ivec3 cell = UnpackCell(cubes[i]);
+			low = glm::min(low, cell);
+			high = glm::max(high, cell);
+		}
+
+		size = high - low + 1;
+	}
+
+	PutSigned(out, low.x);
+	PutSigned(out, low.y);
+	PutSigned(out, low.z);
+	PutVarint(out, size.x);
+	PutVarint(out, size.y);
+
+	// Counting along x, then y, then z matches the order PackCell sorts in, so each step is at least one.
+	uint64_t last = 0;
+
+	for (int i = 0; i < cubes.size(); i++)
+	{
+		glm::ivec3 cell = UnpackCell(cubes[i]) - low;
+		uint64_t index = ((uint64_t)cell.z * size.y + cell.y) * size.x + cell.x;
+
+		PutVarint(out, i == 0 ? index : index - last - 1);
+		last = index;
+	}
+
+	PutSigned(out, actorCell.x - low.x);
+	PutSigned(out, actorCell.y - low.y);
+	PutSigned(out, actorCell.z - low.z);
+	PutSigned(out, goalCell.x - low.x);
+	PutSigned(out, goalCell.y - low.y);
+	PutSigned(out, goalCell.z - low.z);
+}
+
+const uint8_t* PuzzleState::Unpack(const uint8_t* data, PuzzleState& state)
+{
+	state.face = (Face)*data++;
+	state.cubes.resize(GetVarint(data));
+
+	glm::ivec3 low;
+	low.x = GetSigned(data);
+	low.y = GetSigned(data);
+	low.z = GetSigned(data);
+
+	uint64_t sizeX = GetVarint(data);
+	uint64_t sizeY = GetVarint(data);
+
+	uint64_t index = 0;
+
+	for (int i = 0; i < state.cubes.size(); i++)
+	{
+		index += GetVarint(data) + (i == 0 ? 0 : 1);
+
+		glm::ivec3 cell((int)(index % sizeX), (int)(index / sizeX % sizeY), (int)(index / sizeX / sizeY));
+		state.cubes[i] = PackCell(low + cell);
+	}
+
+	state.actorCell.x = low.x + GetSigned(data);
+	state.actorCell.y = low.y + GetSigned(data);
+	state.actorCell.z = low.z + GetSigned(data);
+	state.goalCell.x = low.x + GetSigned(data);
+	state.goalCell.y = low.y + GetSigned(data);
+	state.goalCell.z = low.z + GetSigned(data);
+
+	return data;
+}
+
+void PuzzleState::Transform(const Symmetry& symmetry, glm::ivec3 shift, PuzzleState& out) const
+{
+	out.cubes.resize(cubes.size());
+
+	for (int i = 0; i < cubes.size(); i++)
+	{
+		out.cubes[i] = PackCell(symmetry.Apply(UnpackCell(cubes[i])) + shift);
+	}
+
+	std::sort(out.cubes.begin(), out.cubes.end());
+
+	out.actorCell = symmetry.Apply(actorCell) + shift;
+	out.face = symmetry.Apply(face);
+	out.goalCell = symmetry.Apply(goalCell) + shift;
+	out.Rehash();
+}
+
+int PuzzleState::Canonicalize(const std::vector<int>& symmetries, PuzzleState& out) const
+{
+	const Symmetry* all = Symmetry::All();
+
+	glm::ivec3 low(0);
+	glm::ivec3 high(-1);
+
+	if (cubes.size() > 0)
+	{
+		low = high = UnpackCell(cubes[0]);
+
+		for (int i = 1; i < cubes.size(); i++)
+		{
+			glm::ivec3 cell = UnpackCell(cubes[i]);
+			low = glm::min(low, cell);
+			high = glm::max(high, cell);
+		}
+	}
+
+	// How far an image has to move for its cubes to start at 0, wherever the symmetry put them.
+	auto shiftFor = [&](int s)
+	{
+		glm::ivec3 shift;
+
+		for (int i = 0; i < 3; i++)
+		{
+			int axis = all[s].axes[i];
+			shift[i] = all[s].signs[i] > 0 ? -low[axis] : high[axis] + 1;
+		}
+
+		return shift;
+	};
+
+	// The actor and goal decide it nearly every time, and are quick to turn. The cubes only need turning
+	// for whichever symmetries are still tied after them.
+	auto head = [&](int s)
+	{
+		glm::ivec3 shift = shiftFor(s);
+		glm::ivec3 actor = all[s].Apply(actorCell) + shift;
+		glm::ivec3 goal = all[s].Apply(goalCell) + shift;
+
+		return std::make_tuple((int)all[s].Apply(face), actor.x, actor.y, actor.z, goal.x, goal.y, goal.z);
+	};
+
+	auto first = head(symmetries[0]);
+
+	for (int i = 1; i < symmetries.size(); i++)
+	{
+		first = std::min(first, head(symmetries[i]));
+	}
+
+	int best = -1;
+	PuzzleState other;
+
+	for (int i = 0; i < symmetries.size(); i++)
+	{
+		if (head(symmetries[i]) != first) continue;
+
+		if (best < 0)
+		{
+			Transform(all[symmetries[i]], shiftFor(symmetries[i]), out);
+			best = symmetries[i];
+			continue;
+		}
+
+		Transform(all[symmetries[i]], shiftFor(symmetries[i]), other);
+
+		if (other.cubes < out.cubes)
+		{
+			std::swap(out, other);
+			best = symmetries[i];
+		}
+	}
+
+	return best;
+}
+
+#pragma endregion
+
+#pragma region Solver
+
+const SolverMove PuzzleSolver::moves[PuzzleSolver::moveCount] =
+{
+	{ false, Face::back }, { false, Face::front }, { false, Face::right }, { false, Face::left },
+	{ true, Face::back }, { true, Face::front }, { true, Face::right }, { true, Face::left },
+};
+
+SolveResult PuzzleSolver::Solve(const PuzzleState& start, Face goalFace, int maxMoves, size_t memoryBytes)
+{
+	static const int chunkSize = 64;
+	static const uint64_t noRecord = TranspositionTable::noRecord;
+
+	auto startTime = std::chrono::steady_clock::now();
+
+	SolveResult result;
+
+	// The records the workers last loaded belonged to the previous search, and are gone.
+	for (int i = 0; i < workers.size(); i++)
+	{
+		workers[i]->current = noRecord;
+	}
+
+	auto isGoal = [&](const PuzzleState& state) { return state.actorCell == state.goalCell && state.face == goalFace; };
+
+	// A symmetry that moved the goal face would make goal states out of states that aren't.
+	symmetries.assign(1, 0);
+
+	for (int i = 1; reduceSymmetry && i < Symmetry::count; i++)
+	{
+		if (Symmetry::All()[i].Apply(goalFace) == goalFace) symmetries.push_back(i);
+	}
+
+	result.inexact = symmetries.size() > 1;
+
+	PuzzleState first = start;
+	first.Rehash();
+
+	PuzzleState image;
+	std::vector<uint8_t> packed;
+	uint64_t hash;
+	uint32_t keyLength = PackRecord(first, image, packed, hash);
+
+	// Moves shuffle cubes around without changing how many there are, much, so the start's size is a fair guess at everyone's.
+	table.Reset(memoryBytes, TranspositionTable::RecordSize((uint32_t)packed.size()));
+
+	uint64_t startRecord = noRecord;
+	result.outOfMemory = table.Insert(hash, packed.data(), keyLength, (uint32_t)packed.size(), noRecord, 0, startRecord) == TranspositionTable::InsertResult::full;
+
+	uint64_t goalRecord = startRecord != noRecord && isGoal(first) ? startRecord : noRecord;
+
+	std::vector<uint64_t> frontier;
+	if (startRecord != noRecord) frontier.push_back(startRecord);
+
+	for (int depth = 0; goalRecord == noRecord && !result.outOfMemory && depth < maxMoves && frontier.size() > 0; depth++)
+	{
+		// Each chunk collects what it finds on its own, and the chunks are put together in order.
+		int chunks = ((int)frontier.size() + chunkSize - 1) / chunkSize;
+		std::vector<std::vector<uint64_t>> found(chunks);
+		std::vector<uint64_t> goals(chunks, noRecord);
+		std::atomic<bool> full(false);
+
+		ThreadPool::main.ParallelFor((int)frontier.size(), chunkSize, [&](int chunk, int begin, int end)
+		{
+			Worker* worker = AcquireWorker();
+
+			for (int i = begin; i < end; i++)
+			{
+				uint64_t record = frontier[i];
+
+				UnpackRecord(record, worker->image, worker->state);
+
+				for (int m = 0; m < moveCount; m++)
+				{
+					if (!TryMove(*worker, worker->state, record, moves[m], worker->next)) continue;
+
+					uint64_t hash;
+					uint32_t keyLength = PackRecord(worker->next, worker->image, worker->packed, hash);
+
+					uint64_t added;
+					TranspositionTable::InsertResult inserted = table.Insert(hash, worker->packed.data(), keyLength, (uint32_t)worker->packed.size(), record, (uint8_t)m, added);
+
+					if (inserted == TranspositionTable::InsertResult::full) full = true;
+					if (inserted != TranspositionTable::InsertResult::added) continue;
+
+					found[chunk].push_back(added);
+					if (goals[chunk] == noRecord && isGoal(worker->next)) goals[chunk] = added;
+				}
+			}
+
+			ReleaseWorker(worker);
+		});
+
+		result.expanded += frontier.size();
+
+		// States that didn't fit are lost, but a goal that did is still the first at this depth.
+		result.outOfMemory = full;
+
+		frontier.clear();
+
+		for (int c = 0; c < chunks; c++)
+		{
+			if (goalRecord == noRecord) goalRecord = goals[c];
+			frontier.insert(frontier.end(), found[c].begin(), found[c].end());
+		}
+	}
+
+	result.generated = table.Count();
+
+	if (goalRecord != noRecord)
+	{
+		result.solved = true;
+		result.outOfMemory = false;
+
+		for (uint64_t record = goalRecord; record != startRecord; record = table.Parent(record))
+		{
+			result.moves.push_back(moves[table.Move(record)]);
+		}
+
+		std::reverse(result.moves.begin(), result.moves.end());
+	}
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	table.Clear();
+	return result;
+}
+
+uint32_t PuzzleSolver::PackRecord(const PuzzleState& state, PuzzleState& image, std::vector<uint8_t>& packed, uint64_t& hash) const
+{
+	if (symmetries.size() == 1)
+	{
+		state.Pack(packed);
+		hash = state.hash;
+		return (uint32_t)packed.size();
+	}
+
+	int symmetry = state.Canonicalize(symmetries, image);
+	image.Pack(packed);
+	hash = image.hash;
+
+	// After the key, how to get the state back: the symmetry that undoes the image's, and then how far to move it.
+	const Symmetry& inverse = Symmetry::All()[Symmetry::All()[symmetry].inverse];
+	glm::ivec3 shift = state.actorCell - inverse.Apply(image.actorCell);
+
+	uint32_t keyLength = (uint32_t)packed.size();
+	packed.push_back((uint8_t)Symmetry::All()[symmetry].inverse);
+	PutSigned(packed, shift.x);
+	PutSigned(packed, shift.y);
+	PutSigned(packed, shift.z);
+
+	return keyLength;
+}
+
+void PuzzleSolver::UnpackRecord(uint64_t record, PuzzleState& image, PuzzleState& state) const
+{
+	if (symmetries.size() == 1)
+	{
+		PuzzleState::Unpack(table.Packed(record), state);
+		state.hash = table.Hash(record);
+		return;
+	}
+
+	// Expanding the image would do just as well for finding a solution, but then the moves found wouldn't
+	// follow on from one another; putting it back keeps them a path from the start.
+	PuzzleState::Unpack(table.Packed(record), image);
+
+	const uint8_t* extra = table.Extra(record);
+	const Symmetry& inverse = Symmetry::All()[*extra++];
+
+	glm::ivec3 shift;
+	shift.x = GetSigned(extra);
+	shift.y = GetSigned(extra);
+	shift.z = GetSigned(extra);
+
+	image.Transform(inverse, shift, state);
+}
+
+PuzzleSolver::Worker* PuzzleSolver::AcquireWorker()
+{
+	std::lock_guard<std::mutex> lock(workerMutex);
+
+	if (idleWorkers.size() == 0)
+	{
+		workers.push_back(std::make_unique<Worker>());
+
+		Worker* worker = workers.back().get();
+		worker->sim.Subscribe([worker](const MoveEvent& move) { worker->last = &move; });
+
+		return worker;
+	}
+
+	Worker* worker = idleWorkers.back();
+	idleWorkers.pop_back();
+
+	return worker;
+}
+
+void PuzzleSolver::ReleaseWorker(Worker* worker)
+{
+	std::lock_guard<std::mutex> lock(workerMutex);
+	idleWorkers.push_back(worker);
+}
+
+void PuzzleSolver::Load(Worker& worker, const PuzzleState& state, uint64_t record)
+{
+	// A state's moves are tried one after another, and a move that fails leaves it as it was.
+	if (worker.current == record) return;
+
+	// Both lists are sorted, so one pass over them finds the cells to empty and the cells to fill.
+	const std::vector<uint64_t>& want = state.cubes;
+	const std::vector<uint64_t>& have = worker.loaded;
+
+	int i = 0, j = 0;
+
+	while (i < have.size() || j < want.size())
+	{
+		if (j == want.size() || (i < have.size() && have[i] < want[j]))
+		{
+			glm::ivec3 cell = PuzzleState::UnpackCell(have[i++]);
+			EntityHandle cube = worker.sim.grid.Get(cell.x, cell.y, cell.z);
+
+			if (!cube.IsNull()) worker.freeIndices.push_back(cube.Index());
+			worker.sim.Remove(cell.x, cell.y, cell.z);
+		}
+		else if (i == have.size() || want[j] < have[i])
+		{
+			glm::ivec3 cell = PuzzleState::UnpackCell(want[j++]);
+			uint32_t index;
+
+			if (worker.freeIndices.size() > 0)
+			{
+				index = worker.freeIndices.back();
+				worker.freeIndices.pop_back();
+			}
+			else
+			{
+				index = worker.nextIndex++;
+			}
+
+			worker.sim.Place(cell.x, cell.y, cell.z, EntityHandle::Make(index, 1));
+		}
+		else
+		{
+			i++;
+			j++;
+		}
+	}
+
+	worker.loaded = want;
+	worker.current = record;
+}
+
+bool PuzzleSolver::TryMove(Worker& worker, const PuzzleState& from, uint64_t record, SolverMove move, PuzzleState& to)
+{
+	Load(worker, from, record);
+
+	SimActor actor = { EntityHandle(), worker.sim.grid.Get(from.actorCell.x, from.actorCell.y, from.actorCell.z), from.actorCell, from.face };
+	Face direction = Util::GetAbsoluteFace(from.face, move.direction);
+
+	bool moved;
+
+	if (move.roll)
+	{
+		moved = worker.sim.Roll(actor, direction);
+	}
+	else
+	{
+		glm::vec3 step = Util::GetRelativeUp(direction);
+		moved = worker.sim.Walk(actor, (int)step.x, (int)step.y, (int)step.z);
+	}
+
+	if (!moved) return false;
+
+	to = from;
+	to.actorCell = actor.cell;
+	to.face = actor.face;
+	to.hash ^= PuzzleSim::ActorKey(from.actorCell, from.face) ^ PuzzleSim::ActorKey(to.actorCell, to.face);
+
+	// Everything leaves its old cell before anything lands, as in the sim. Two cubes landing in
+	// one cell leave one cube behind there, in the grid and here alike.
+	const std::vector<CubeMove>& cubes = worker.last->cubes;
+
+	for (int i = 0; i < cubes.size(); i++)
+	{
+		auto it = std::lower_bound(to.cubes.begin(), to.cubes.end(), PuzzleState::PackCell(cubes[i].from));
+
+		if (it != to.cubes.end() && *it == PuzzleState::PackCell(cubes[i].from))
+		{
+			to.cubes.erase(it);
+			to.hash ^= PuzzleSim::CellKey(cubes[i].from, 0);
+		}
+
+		if (cubes[i].from == from.goalCell) to.goalCell = cubes[i].to;
+	}
+
+	to.hash ^= PuzzleSim::CellKey(from.goalCell, 0) ^ PuzzleSim::CellKey(from.goalCell, PuzzleState::goalType);
+	to.hash ^= PuzzleSim::CellKey(to.goalCell, 0) ^ PuzzleSim::CellKey(to.goalCell, PuzzleState::goalType);
+
+	for (int i = 0; i < cubes.size(); i++)
+	{
+		uint64_t cell = PuzzleState::PackCell(cubes[i].to);
+
+		auto it = std::lower_bound(to.cubes.begin(), to.cubes.end(), cell);
+		if (it == to.cubes.end() || *it != cell)
+		{
+			to.cubes.insert(it, cell);
+			to.hash ^= PuzzleSim::CellKey(cubes[i].to, 0);
+		}
+	}
+
+	// The sim now holds the new state, so the next Load starts from there.
+	worker.loaded = to.cubes;
+	worker.current = TranspositionTable::noRecord;
+	return true;
+}
+
+#pragma endregion
+
+#pragma region Solving On Disk
+
+SolveResult PuzzleSolver::SolveOnDisk(const PuzzleState& start, Face goalFace, int maxMoves)
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	SolveResult result;
+
+	for (int i = 0; i < workers.size(); i++)
+	{
+		workers[i]->current = TranspositionTable::noRecord;
+	}
+
+	auto isGoal = [&](const PuzzleState& state) { return state.actorCell == state.goalCell && state.face == goalFace; };
+
+	std::filesystem::path directory = disk.directory.empty() ? std::filesystem::temp_directory_path() / "unending-solver" : std::filesystem::path(disk.directory);
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	auto depthPath = [&](int depth) { return (directory / ("depth-" + std::to_string(depth))).string(); };
+	std::string seenPath = (directory / "seen").string();
+	std::string seenNextPath = (directory / "seen-next").string();
+	std::string runPrefix = (directory / "run-").string();
+
+	std::vector<uint8_t> packed;
+	start.Pack(packed);
+
+	// The start is depth 0, and all that's been seen.
+	{
+		RunWriter depth0, seen;
+		bool opened = depth0.Open(depthPath(0)) && seen.Open(seenPath);
+
+		depth0.Write(packed.data(), (uint32_t)packed.size());
+		seen.Write(packed.data(), (uint32_t)packed.size());
+
+		if (!depth0.Close() || !seen.Close() || !opened) result.diskError = true;
+	}
+
+	result.generated = 1;
+
+	int depths = 1;
+	int goalDepth = isGoal(start) ? 0 : -1;
+	std::vector<uint8_t> goal = packed;
+
+	uint64_t stamp = 0;
+
+	std::vector<uint8_t> buffer;
+	std::vector<Pending> pending;
+	std::vector<std::string> runs;
+
+	for (int depth = 0; goalDepth < 0 && !result.diskError && depth < maxMoves; depth++)
+	{
+		buffer.clear();
+		pending.clear();
+		runs.clear();
+
+		// Every worker's reached states go into the buffer, and out to runs whenever it fills up.
+		auto collect = [&]()
+		{
+			for (int i = 0; i < workers.size(); i++)
+			{
+				Worker& worker = *workers[i];
+				uint64_t offset = buffer.size();
+
+				buffer.insert(buffer.end(), worker.reached.begin(), worker.reached.end());
+
+				for (int j = 0; j < worker.reachedLengths.size(); j++)
+				{
+					pending.push_back({ offset, worker.reachedLengths[j] });
+					offset += worker.reachedLengths[j];
+				}
+
+				worker.reached.clear();
+				worker.reachedLengths.clear();
+
+				if (goalDepth < 0 && worker.goal.size() > 0)
+				{
+					goalDepth = depth + 1;
+					goal = worker.goal;
+				}
+
+				worker.goal.clear();
+			}
+
+			if (pending.size() > 0 && buffer.size() + pending.size() * sizeof(Pending) >= disk.memoryBytes)
+			{
+				if (!SpillRuns(buffer, pending, runPrefix, runs)) result.diskError = true;
+				result.spills++;
+			}
+
+			return goalDepth < 0 && !result.diskError;
+		};
+
+		uint64_t before = stamp;
+
+		bool read = ExpandFile(depthPath(depth), stamp, [&](Worker& worker, uint64_t, int)
+		{
+			worker.reached.insert(worker.reached.end(), worker.packed.begin(), worker.packed.end());
+			worker.reachedLengths.push_back((uint32_t)worker.packed.size());
+
+			if (worker.goal.size() == 0 && isGoal(worker.next)) worker.goal = worker.packed;
+		}, collect);
+
+		result.expanded += stamp - before;
+
+		if (!read) result.diskError = true;
+		if (goalDepth >= 0 || result.diskError) break;
+
+		if (pending.size() > 0)
+		{
+			if (!SpillRuns(buffer, pending, runPrefix, runs)) result.diskError = true;
+			result.spills++;
+		}
+
+		depths = depth + 2;
+
+		uint64_t fresh = 0;
+		if (!result.diskError && !MergeRuns(runs, seenPath, depthPath(depth + 1), seenNextPath, fresh)) result.diskError = true;
+
+		for (int i = 0; i < runs.size(); i++)
+		{
+			std::filesystem::remove(runs[i], error);
+		}
+
+		runs.clear();
+		std::filesystem::rename(seenNextPath, seenPath, error);
+		if (error) result.diskError = true;
+
+		result.generated += fresh;
+
+		if (fresh == 0) break;
+	}
+
+	// Back through the depths, for the state each one's goal was reached from.
+	if (goalDepth >= 0 && !result.diskError)
+	{
+		result.moves.resize(goalDepth);
+		std::vector<uint8_t> target = goal;
+
+		for (int depth = goalDepth - 1; depth >= 0; depth--)
+		{
+			std::mutex mutex;
+			uint64_t found = TranspositionTable::noRecord;
+			int foundMove = 0;
+			std::vector<uint8_t> parent;
+
+			bool read = ExpandFile(depthPath(depth), stamp, [&](Worker& worker, uint64_t index, int move)
+			{
+				if (worker.packed != target) return;
+
+				std::lock_guard<std::mutex> lock(mutex);
+
+				if (index < found || (index == found && move < foundMove))
+				{
+					found = index;
+					foundMove = move;
+					worker.state.Pack(parent);
+				}
+			}, [&]() { return found == TranspositionTable::noRecord; });
+
+			if (!read || found == TranspositionTable::noRecord)
+			{
+				result.diskError = true;
+				break;
+			}
+
+			result.moves[depth] = moves[foundMove];
+			target = parent;
+		}
+
+		result.solved = !result.diskError;
+	}
+
+	for (int depth = 0; depth < depths; depth++)
+	{
+		std::filesystem::remove(depthPath(depth), error);
+	}
+
+	for (int i = 0; i < runs.size(); i++)
+	{
+		std::filesystem::remove(runs[i], error);
+	}
+
+	std::filesystem::remove(seenPath, error);
+	std::filesystem::remove(seenNextPath, error);
+
+	if (result.diskError) result.moves.clear();
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	return result;
+}
+
+bool PuzzleSolver::ExpandFile(const std::string& path, uint64_t& stamp, const std::function<void(Worker&, uint64_t, int)>& visit, const std::function<bool()>& afterBatch)
+{
+	static const int batchSize = 1 << 14;
+	static const int chunkSize = 64;
+
+	RunReader reader;
+	if (!reader.Open(path)) return false;
+
+	// Every state in a batch can reach moveCount more before afterBatch gets to spill them, so a batch is
+	// kept to a share of the memory budget as well; always at least one state, however small that is.
+	size_t batchBytes = std::max<size_t>(1, disk.memoryBytes / moveCount);
+
+	std::vector<uint8_t> bytes;
+	std::vector<size_t> starts;
+	uint64_t index = 0;
+
+	while (true)
+	{
+		bytes.clear();
+		starts.clear();
+
+		while (starts.size() < batchSize && bytes.size() < batchBytes && reader.Next())
+		{
+			starts.push_back(bytes.size());
+			bytes.insert(bytes.end(), reader.Data(), reader.Data() + reader.Length());
+		}
+
+		if (starts.size() == 0) break;
+
+		ThreadPool::main.ParallelFor((int)starts.size(), chunkSize, [&](int, int begin, int end)
+		{
+			Worker* worker = AcquireWorker();
+
+			for (int i = begin; i < end; i++)
+			{
+				PuzzleState::Unpack(bytes.data() + starts[i], worker->state);
+
+				// Nothing on disk is looked up by its hash.
+				worker->state.hash = 0;
+
+				for (int m = 0; m < moveCount; m++)
+				{
+					// The stamp stands in for a record, so that a worker knows when it already has a state loaded.
+					if (!TryMove(*worker, worker->state, stamp + i, moves[m], worker->next)) continue;
+
+					worker->next.Pack(worker->packed);
+					visit(*worker, index + i, m);
+				}
+			}
+
+			ReleaseWorker(worker);
+		});
+
+		stamp += starts.size();
+		index += starts.size();
+
+		if (!afterBatch()) return !reader.Failed();
+	}
+
+	return !reader.Failed();
+}
+
+bool PuzzleSolver::SpillRuns(std::vector<uint8_t>& buffer, std::vector<Pending>& pending, const std::string& prefix, std::vector<std::string>& runs)
+{
+	if (pending.size() == 0) return true;
+
+	int workerCount = std::max(1, disk.sortWorkers);
+	int share = ((int)pending.size() + workerCount - 1) / workerCount;
+
+	int first = (int)runs.size();
+	for (int i = 0; i * share < pending.size(); i++)
+	{
+		runs.push_back(prefix + std::to_string(first + i));
+	}
+
+	std::atomic<bool> failed(false);
+
+	ThreadPool::main.ParallelFor((int)pending.size(), share, [&](int chunk, int begin, int end)
+	{
+		const uint8_t* base = buffer.data();
+
+		std::sort(pending.begin() + begin, pending.begin() + end, [&](const Pending& a, const Pending& b)
+		{
+			return RunWriter::Compare(base + a.offset, a.length, base + b.offset, b.length) < 0;
+		});
+
+		RunWriter writer;
+		bool opened = writer.Open(runs[first + chunk]);
+
+		for (int i = begin; i < end; i++)
+		{
+			writer.Write(base + pending[i].offset, pending[i].length);
+		}
+
+		if (!writer.Close() || !opened) failed = true;
+	});
+
+	buffer.clear();
+	pending.clear();
+
+	return !failed;
+}
+
+bool PuzzleSolver::MergeRuns(const std::vector<std::string>& runs, const std::string& seen, const std::string& fresh, const std::string& seenNext, uint64_t& freshCount)
+{
+	std::vector<std::unique_ptr<RunReader>> readers;
+	bool ok = true;
+
+	// The readers with a state left, smallest state on top.
+	auto greater = [&](int a, int b)
+	{
+		return RunWriter::Compare(readers[a]->Data(), readers[a]->Length(), readers[b]->Data(), readers[b]->Length()) > 0;
+	};
+
+	std::priority_queue<int, std::vector<int>, decltype(greater)> heap(greater);
+
+	for (int i = 0; i < runs.size(); i++)
+	{
+		readers.push_back(std::make_unique<RunReader>());
+		if (!readers[i]->Open(runs[i])) ok = false;
+		if (readers[i]->Next()) heap.push(i);
+	}
+
+	RunReader old;
+	ok = old.Open(seen) && ok;
+	bool oldLeft = old.Next();
+
+	RunWriter freshWriter, seenWriter;
+	ok = freshWriter.Open(fresh) && ok;
+	ok = seenWriter.Open(seenNext) && ok;
+
+	while (heap.size() > 0)
+	{
+		int top = heap.top();
+		heap.pop();
+
+		const uint8_t* data = readers[top]->Data();
+		uint32_t length = readers[top]->Length();
+
+		int order = -1;
+
+		while (oldLeft && (order = RunWriter::Compare(old.Data(), old.Length(), data, length)) < 0)
+		{
+			seenWriter.Write(old.Data(), old.Length());
+			oldLeft = old.Next();
+		}
+
+		// Seen before, at this depth or one before it; either way the writers drop it.
+		if (!oldLeft || order != 0)
+		{
+			freshWriter.Write(data, length);
+			seenWriter.Write(data, length);
+		}
+
+		if (readers[top]->Next()) heap.push(top);
+	}
+
+	while (oldLeft)
+	{
+		seenWriter.Write(old.Data(), old.Length());
+		oldLeft = old.Next();
+	}
+
+	for (int i = 0; i < readers.size(); i++)
+	{
+		if (readers[i]->Failed()) ok = false;
+	}
+
+	if (old.Failed()) ok = false;
+
+	freshCount = freshWriter.Count();
+
+	ok = freshWriter.Close() && ok;
+	ok = seenWriter.Close() && ok;
+
+	return ok;
+}
+
+#pragma endregion
@@ -0,0 +1,214 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "puzzlesim.h"
+#include "symmetry.h"
+#include "transposition.h"
+
+// A puzzle position as far as the rules are concerned. The rules never tell one cube from another,
+// so the cubes are just a sorted list of occupied cells, and the goal cube is followed by its cell.
+struct PuzzleState
+{
+	std::vector<uint64_t> cubes;	// PackCell'd, in ascending order.
+
+	glm::ivec3 actorCell;
+	Face face;
+
+	glm::ivec3 goalCell;
+
+	// Zobrist hash, as in PuzzleSim: every cube's CellKey, with the goal cube as goalType, and the ActorKey.
+	// Moves update it as they go; Rehash works it out from scratch.
+	uint64_t hash = 0;
+
+	static const uint8_t goalType = 1;
+
+	bool operator==(const PuzzleState& rhs) const noexcept
+	{
+		return hash == rhs.hash && actorCell == rhs.actorCell && face == rhs.face && goalCell == rhs.goalCell && cubes == rhs.cubes;
+	}
+
+	void Rehash();
+
+	// 21 bits a coordinate, offset so that negative coordinates sort below positive ones.
+	static uint64_t PackCell(glm::ivec3 cell);
+	static glm::ivec3 UnpackCell(uint64_t packed);
+
+	// Reads every cube out of a grid.
+	static PuzzleState Capture(const VoxelGrid& grid, const SimActor& actor, glm::ivec3 goalCell);
+
+	// A few bytes for the actor and the bounds of the cubes, then each cube's distance from the one before
+	// it, counting cells across the bounds in the same order as cubes is sorted in. Cubes mostly sit in
+	// runs, so that's usually a byte a cube. Equal states always pack to equal bytes, so packed states can
+	// be compared with memcmp. The hash is left out.
+	void Pack(std::vector<uint8_t>& out) const;
+
+	// Reads a packed state back, leaving the hash alone. Returns the end of the packed bytes.
+	static const uint8_t* Unpack(const uint8_t* data, PuzzleState& state);
+
+	// This state turned or mirrored, then moved by shift, and rehashed. out can't be this state.
+	void Transform(const Symmetry& symmetry, glm::ivec3 shift, PuzzleState& out) const;
+
+	// Of this state's images under some symmetries (indices into Symmetry::All()), each moved so that its
+	// cubes start at 0, the one that sorts first: by face, then actor cell, goal cell and cubes. States that
+	// are turns, mirrors or shifts of one another all end up with the same image. Returns the symmetry
+	// that made it.
+	int Canonicalize(const std::vector<int>& symmetries, PuzzleState& out) const;
+};
+
+struct PuzzleStateHash
+{
+	size_t operator()(const PuzzleState& state) const noexcept { return (size_t)state.hash; }
+};
+
+// One input, the way the player gives it: a walk or a roll, in a direction relative to the face
+// they're standing on (Face::back is forward, as in InputSystem).
+struct SolverMove
+{
+	bool roll;
+	Face direction;
+};
+
+struct SolveResult
+{
+	bool solved = false;
+	std::vector<SolverMove> moves;	// A shortest solution, when there is one (but see reduceSymmetry).
+
+	uint64_t expanded = 0;		// States that had every move tried on them.
+	uint64_t generated = 0;		// Distinct states reached, the start included.
+	double seconds = 0.0;
+
+	bool outOfMemory = false;	// The memory budget ran out before the search did.
+	bool diskError = false;		// SolveOnDisk couldn't write or read one of its files.
+	uint64_t spills = 0;		// How many times SolveOnDisk sorted what it had reached out to runs.
+	bool inexact = false;		// Searched with reduceSymmetry: a solution may not be the shortest, and no solution isn't proof there's none.
+
+	double NodesPerSecond() const { return seconds > 0.0 ? expanded / seconds : 0.0; }
+};
+
+// Where SolveOnDisk keeps its files, and how it sorts them.
+struct DiskSearchSettings
+{
+	std::string directory;				// Made if it isn't there; the system's temporary directory if empty.
+	size_t memoryBytes = 256ull << 20;	// How much of the states reached to hold before sorting them out to disk.
+	int sortWorkers = 4;				// Each sorts a share of those states into a run file of its own.
+};
+
+// Finds the fewest walks and rolls that leave the actor standing on the goal cube's goal face.
+//
+// The search is breadth-first, a whole depth at a time. Each depth's frontier is split into chunks
+// expanded in parallel on ThreadPool::main (start it first), and every state reached so far goes
+// into one TranspositionTable shared by all the threads, so each state is expanded once and the first
+// depth with a goal state in it is the optimal move count. Which of two equally short paths to a state
+// is kept depends on thread timing; the length never does.
+//
+// States are only kept packed, in the table, alongside the state they were reached from, so a
+// frontier is just a list of record offsets and a solution is walked back through the records.
+//
+// Breadth-first rather than A*: the goal cube moves along with whatever structure it is part of, so
+// there is no estimate of the moves left that is both admissible and better than zero.
+class PuzzleSolver
+{
+public:
+	static const int moveCount = 8;
+	static const SolverMove moves[moveCount];
+
+	static const size_t defaultMemory = 1ull << 30;
+
+	// Counts states that are turns, mirrors or shifts of each other, keeping the goal face where it is, as
+	// one, which on a symmetric level can be up to 8 times fewer. Off by default, because the rules themselves
+	// aren't quite symmetric, not even under shifts: roll sweeps follow a cube's corner, which sits on a
+	// different side of the cube once it's turned or mirrored, and a roll that's cut short rounds towards
+	// zero, which is a different way either side of it. So now and then two folded states really have
+	// different moves, and the one that isn't expanded might have been the only way on. Solutions are always
+	// real, being replayed moves from the start, but results say they're inexact: a solution may not be the
+	// shortest, and not finding one proves nothing.
+	bool reduceSymmetry = false;
+
+	// Gives up, unsolved, after maxMoves, or once memoryBytes is full of states.
+	SolveResult Solve(const PuzzleState& start, Face goalFace, int maxMoves, size_t memoryBytes = defaultMemory);
+
+	DiskSearchSettings disk;
+
+	// The same search, for levels with more states than fit in memory. Each depth is a RunWriter file of
+	// packed states. Expanding a depth gathers the states it reaches until disk.memoryBytes is full, then
+	// sorts them out to runs; merging the runs, and dropping whatever is already in the file of every state
+	// seen so far, makes the next depth. Nothing remembers where a state came from, so the solution is
+	// found afterwards, by going back through the depths for a state that moves into the one after.
+	// Always exact: reduceSymmetry is ignored, this being for proving move counts. Removes its files after.
+	SolveResult SolveOnDisk(const PuzzleState& start, Face goalFace, int maxMoves);
+
+private:
+	// A sim to try moves on. Loading a state only touches the cells that differ from the one loaded
+	// before, and the states a chunk expands one after another are mostly alike.
+	struct Worker
+	{
+		PuzzleSim sim;
+		std::vector<uint64_t> loaded;
+		uint64_t current = TranspositionTable::noRecord;	// The record that was loaded last, if no move has been made since.
+
+		// Scratch space for unpacking a state, moving from it, and packing the result.
+		PuzzleState state;
+		PuzzleState next;
+		PuzzleState image;
+		std::vector<uint8_t> packed;
+
+		// Handles for the cubes placed in the sim; every cube needs its own for the flood fill stamps.
+		std::vector<uint32_t> freeIndices;
+		uint32_t nextIndex = 1;
+
+		const MoveEvent* last = nullptr;
+
+		// What SolveOnDisk's expansions leave here, packed one after another, until they're collected.
+		std::vector<uint8_t> reached;
+		std::vector<uint32_t> reachedLengths;
+		std::vector<uint8_t> goal;
+	};
+
+	// A span of SolveOnDisk's buffer of reached states.
+	struct Pending
+	{
+		uint64_t offset;
+		uint32_t length;
+	};
+
+	TranspositionTable table;
+	std::vector<int> symmetries;	// The ones in use for this search; just the identity, unless reduceSymmetry.
+
+	std::mutex workerMutex;
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<Worker*> idleWorkers;
+
+	Worker* AcquireWorker();
+	void ReleaseWorker(Worker* worker);
+
+	// With reduceSymmetry, states go into the table as their canonical image, followed by how to get back
+	// from it. These pack one in, returning the key length, and read it back out as it was.
+	uint32_t PackRecord(const PuzzleState& state, PuzzleState& image, std::vector<uint8_t>& packed, uint64_t& hash) const;
+	void UnpackRecord(uint64_t record, PuzzleState& image, PuzzleState& state) const;
+
+	// Reads a depth's file a batch at a time, tries every move on every state in parallel, and calls visit
+	// with the worker, the state's place in the file and the move, for every move that worked (the new
+	// state is in worker.next and worker.packed). afterBatch can stop it by returning false.
+	bool ExpandFile(const std::string& path, uint64_t& stamp, const std::function<void(Worker&, uint64_t, int)>& visit, const std::function<bool()>& afterBatch);
+
+	// Sorts the buffered states, in disk.sortWorkers pieces, each out to a run file of its own.
+	bool SpillRuns(std::vector<uint8_t>& buffer, std::vector<Pending>& pending, const std::string& prefix, std::vector<std::string>& runs);
+
+	// Merges runs into one, leaving out what's in seen. What's left is written to fresh and, along with
+	// everything from seen, to seenNext.
+	static bool MergeRuns(const std::vector<std::string>& runs, const std::string& seen, const std::string& fresh, const std::string& seenNext, uint64_t& freshCount);
+
+	static void Load(Worker& worker, const PuzzleState& state, uint64_t record);
+	static bool TryMove(Worker& worker, const PuzzleState& from, uint64_t record, SolverMove move, PuzzleState& to);
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "symmetry.h"
+
+#include <vector>
+
+glm::ivec3 Symmetry::Apply(glm::ivec3 cell) const
+{
+	glm::ivec3 result;
+
+	for (int i = 0; i < 3; i++)
+	{
+		int c = cell[axes[i]];
+		result[i] = signs[i] > 0 ? c : -c - 1;
+	}
+
+	return result;
+}
+
+static std::vector<Symmetry> BuildSymmetries()
+{
+	std::vector<Symmetry> all;
+
+	static const int permutations[6][3] = { { 0, 1, 2 }, { 1, 2, 0 }, { 2, 0, 1 }, { 0, 2, 1 }, { 2, 1, 0 }, { 1, 0, 2 } };
+	static const int evenPermutations = 3;
+
+	// Turns first, so that the first 24 are the turns: an even permutation with an even number of flips,
+	// or an odd one with an odd number.
+	for (int mirrored = 0; mirrored < 2; mirrored++)
+	{
+		for (int p = 0; p < 6; p++)
+		{
+			for (int flips = 0; flips < 8; flips++)
+			{
+				int flipCount = (flips & 1) + ((flips >> 1) & 1) + ((flips >> 2) & 1);
+				bool turn = (p < evenPermutations) == (flipCount % 2 == 0);
+				if (turn == (mirrored == 1)) continue;
+
+				Symmetry symmetry;
+
+				for (int i = 0; i < 3; i++)
+				{
+					symmetry.axes[i] = permutations[p][i];
+					symmetry.signs[i] = (flips >> i) & 1 ? -1 : 1;
+				}
+
+				// Each face is a direction, and goes where its direction goes; its opposite goes opposite.
+				const Face positive[3] = { Face::right, Face::top, Face::back };
+
+				for (int f = 0; f < 3; f++)
+				{
+					glm::vec3 up = Util::GetRelativeUp(positive[f]);
+					glm::vec3 turned;
+
+					for (int i = 0; i < 3; i++)
+					{
+						turned[i] = up[symmetry.axes[i]] * symmetry.signs[i];
+					}
+
+					Face to = Util::GetFaceFromDifference(turned);
+					symmetry.faces[(int)positive[f]] = to;
+					symmetry.faces[(int)Util::OppositeFace(positive[f])] = Util::OppositeFace(to);
+				}
+
+				all.push_back(symmetry);
+			}
+		}
+	}
+
+	// Whichever one sends every face back where it came from.
+	for (int i = 0; i < Symmetry::count; i++)
+	{
+		for (int j = 0; j < Symmetry::count; j++)
+		{
+			bool undoes = true;
+
+			for (int f = 0; f < 6; f++)
+			{
+				if (all[j].faces[(int)all[i].faces[f]] != (Face)f) undoes = false;
+			}
+
+			if (undoes) all[i].inverse = j;
+		}
+	}
+
+	return all;
+}
+
+const Symmetry* Symmetry::All()
+{
+	static const std::vector<Symmetry> all = BuildSymmetries();
+	return all.data();
+}
@@ -0,0 +1,29 @@
+#ifndef SYMMETRY_H
+#define SYMMETRY_H
+
+#include <glm/glm.hpp>
+
+#include "util.h"
+
+// One of the 48 ways to turn and mirror the grid onto itself: a permutation of the axes, with some of
+// them flipped. The first 24 are the turns; the rest mirror as well. All()[0] leaves everything alone.
+//
+// A flipped axis sends cell c to -c - 1, so that the cube filling cell c lands exactly on a cell
+// rather than straddling two.
+struct Symmetry
+{
+	static const int count = 48;
+
+	int axes[3];		// Axis i of the result is axis axes[i] of the original...
+	int signs[3];		// ...flipped when this is -1.
+
+	Face faces[6];		// Where each face ends up, by Face.
+	int inverse;		// The index of the symmetry that undoes this one.
+
+	glm::ivec3 Apply(glm::ivec3 cell) const;
+	Face Apply(Face face) const { return faces[(int)face]; }
+
+	static const Symmetry* All();
+};
+
+#endif
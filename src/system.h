@@ -2,27 +2,231 @@
 #define SYSTEM_H
 
 #include <vector>
+#include <tuple>
+#include <unordered_map>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "component.h"
+#include "entity.h"
+#include "renderer.h"
+#include "grid.h"
+#include "threadpool.h"
+
+// Maps entity slots to rows in a system's columns, so that removing an entity
+// is a lookup plus moving the last row into the hole rather than a scan.
+struct SparseSet
+{
+	std::vector<int> rows;			// Indexed by entity slot; -1 if the entity isn't in the system.
+	std::vector<uint32_t> slots;	// Indexed by row; the entity slot that owns the row.
+
+	void Add(Entity* e)
+	{
+		uint32_t slot = e->GetHandle().Index();
+		if (slot >= rows.size()) rows.resize(slot + 1, -1);
+
+		rows[slot] = (int)slots.size();
+		slots.push_back(slot);
+	}
+
+	// Returns the row the entity vacated, or -1 if it wasn't present.
+	// The caller is expected to SwapRemove that row from each of its columns.
+	int Remove(Entity* e)
+	{
+		uint32_t slot = e->GetHandle().Index();
+		if (slot >= rows.size() || rows[slot] == -1) return -1;
 
-class Component;
-class PositionComponent;
-class CubeComponent;
-class AnimationComponent;
-class AnimationControllerComponent;
-class InputComponent;
-class CameraFollowComponent;
-class BillboardingComponent;
-class ActorComponent;
-class MovementComponent;
-class ModelComponent;
-
-class System
+		int row = rows[slot];
+		uint32_t lastSlot = slots.back();
+
+		slots[row] = lastSlot;
+		rows[lastSlot] = row;
+		slots.pop_back();
+		rows[slot] = -1;
+
+		return row;
+	}
+};
+
+template <typename T>
+void SwapRemove(std::vector<T>& column, int row)
+{
+	column[row] = column.back();
+	column.pop_back();
+}
+
+// The rows of a query that belong to one scene: one column per component type,
+// kept row-aligned, with membership tracked by a sparse set.
+template <typename... Ts>
+class ScenePartition
 {
 public:
-	virtual void Update(int activeScene, float deltaTime) = 0;
-	virtual void AddComponent(Component* component) = 0;
-	virtual void PurgeEntity(Entity* e) = 0;
+	SparseSet members;
+	std::tuple<std::vector<Ts*>...> columns;
+
+	template <typename T>
+	std::vector<T*>& Column()
+	{
+		return std::get<std::vector<T*>>(columns);
+	}
+
+	int Size() const
+	{
+		return (int)members.slots.size();
+	}
+
+	void Add(Entity* e)
+	{
+		members.Add(e);
+		(std::get<std::vector<Ts*>>(columns).push_back(e->Get<Ts>()), ...);
+	}
+
+	void Remove(Entity* e)
+	{
+		int row = members.Remove(e);
+		if (row == -1) return;
+
+		(SwapRemove(std::get<std::vector<Ts*>>(columns), row), ...);
+	}
+
+	template <typename F>
+	void ForEach(int begin, int end, F&& f)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			f(std::get<std::vector<Ts*>>(columns)[i]...);
+		}
+	}
+};
+
+// A system's joined view of the entities it works on, split up by scene.
+// Systems only ever look at the global scene (0) and the active one, so the other
+// partitions cost nothing per frame, and switching ECS::activeScene just points
+// the next frame at a different partition.
+// The component types are fixed at compile time, so ForEach is a plain loop over
+// arrays that the compiler can inline straight into the system's update.
+// An entity's scene has to be set before its components are registered;
+// ECS::ChangeScene moves a live entity between partitions.
+template <typename... Ts>
+class Query
+{
+public:
+	static constexpr uint32_t signature = ComponentSignature<Ts...>();
+
+	std::vector<ScenePartition<Ts...>> scenes;	// Indexed by scene.
+
+	ScenePartition<Ts...>& Scene(int scene)
+	{
+		if (scene >= scenes.size()) scenes.resize(scene + 1);
+		return scenes[scene];
+	}
+
+	// The partitions a frame in activeScene visits, global scene first.
+	int ActivePartitions(int activeScene, ScenePartition<Ts...>* out[2])
+	{
+		int n = 0;
+
+		if (scenes.size() > 0) out[n++] = &scenes[0];
+		if (activeScene != 0 && activeScene < scenes.size()) out[n++] = &scenes[activeScene];
+
+		return n;
+	}
+
+	void Add(Entity* e)
+	{
+		Scene(e->GetScene()).Add(e);
+	}
+
+	void Remove(Entity* e)
+	{
+		int scene = e->GetScene();
+		if (scene < 0 || scene >= scenes.size()) return;
+
+		scenes[scene].Remove(e);
+	}
+
+	template <typename F>
+	void ForEach(int activeScene, F&& f)
+	{
+		ScenePartition<Ts...>* partitions[2];
+		int n = ActivePartitions(activeScene, partitions);
+
+		for (int p = 0; p < n; p++)
+		{
+			partitions[p]->ForEach(0, partitions[p]->Size(), f);
+		}
+	}
+
+	int ChunkCount(int activeScene, int chunkSize)
+	{
+		ScenePartition<Ts...>* partitions[2];
+		int n = ActivePartitions(activeScene, partitions);
+
+		int chunks = 0;
+		for (int p = 0; p < n; p++)
+		{
+			chunks += (partitions[p]->Size() + chunkSize - 1) / chunkSize;
+		}
+
+		return chunks;
+	}
+
+	// Like ForEach, but fans fixed chunks of rows out over the thread pool.
+	// f also gets the chunk index, so anything it produces can go in a per-chunk
+	// buffer and be merged in chunk order, the same order ForEach would have used.
+	// Chunks never straddle two partitions.
+	template <typename F>
+	void ParallelForEach(int activeScene, int chunkSize, F&& f)
+	{
+		ScenePartition<Ts...>* partitions[2];
+		int n = ActivePartitions(activeScene, partitions);
+
+		int firstChunk[3] = { 0, 0, 0 };
+		for (int p = 0; p < n; p++)
+		{
+			firstChunk[p + 1] = firstChunk[p] + (partitions[p]->Size() + chunkSize - 1) / chunkSize;
+		}
+
+		ThreadPool::main.ParallelFor(firstChunk[n], 1, [&](int chunk, int, int)
+		{
+			int p = chunk < firstChunk[1] ? 0 : 1;
+
+			int begin = (chunk - firstChunk[p]) * chunkSize;
+			int end = begin + chunkSize < partitions[p]->Size() ? begin + chunkSize : partitions[p]->Size();
+
+			partitions[p]->ForEach(begin, end, [&](Ts*... components) { f(chunk, components...); });
+		});
+	}
 };
 
+// Shared state that lives outside the component arrays but that systems still contend over.
+// These take the bits above the component IDs, so a system's reads and writes are each a single mask.
+static_assert(maxComponentTypes <= 16, "Component IDs would overlap the shared resource bits.");
+
+static const uint32_t cameraAccess		= 1u << 17;	// Game::main's camera, view and orientation state.
+static const uint32_t gridAccess		= 1u << 18;	// ECS::main.sim and the entity table.
+static const uint32_t allAccess			= 0xFFFFFFFF;
+
+// Every system says which component types and shared state it reads and writes.
+// ECS orders any two systems that touch the same thing with at least one write the same
+// way they appear in ECS::systems, and lets the rest run side by side on the thread pool.
+// Systems that must stay on the main thread (GLFW input, mostly) set mainThread.
+// Systems that draw fill their own renderBuffers instead of the shared Renderer, and
+// ECS submits those on the main thread once every system is done.
+
+template <typename S, typename = void>
+struct RendersGeometry : std::false_type {};
+
+template <typename S>
+struct RendersGeometry<S, std::void_t<decltype(std::declval<S&>().renderBuffers)>> : std::true_type {};
+
+template <typename S, typename = void>
+struct RendersStaticMeshes : std::false_type {};
+
+template <typename S>
+struct RendersStaticMeshes<S, std::void_t<decltype(std::declval<S&>().staticMeshes)>> : std::true_type {};
+
 struct Chunk
 {
 	int count;
@@ -54,109 +258,135 @@ struct Chunk
 	}
 };
 
-class CubeSystem : public System
+class CubeSystem
 {
 public:
-	std::vector<CubeComponent*> cubes;
+	static constexpr uint32_t reads = ComponentSignature<CubeComponent, PositionComponent, MovementComponent>() | cameraAccess;
+	static constexpr uint32_t writes = gridAccess;	// Clears the grid chunks' dirty flags.
+	static constexpr bool mainThread = false;
 
-	void Update(int activeScene, float deltaTime);
+	static const int chunkSize = 256;
 
-	void AddComponent(Component* component);
+	Query<CubeComponent, PositionComponent, MovementComponent> query;
+	std::vector<RenderBuffer> renderBuffers;	// One per chunk, for cubes that aren't resting in the grid.
 
-	void PurgeEntity(Entity* e);
-};
+	// Resting cubes, meshed once per grid chunk (keyed by VoxelGrid::ChunkKey) and only rebuilt when it changes.
+	// Each scene with cubes in the chunk gets a mesh of its own, so inactive scenes' cubes can be left undrawn.
+	std::unordered_map<uint64_t, std::unordered_map<int, StaticMesh>> staticMeshes;
 
-class AnimationControllerSystem : public System
-{
-public:
-	std::vector<AnimationControllerComponent*> controllers;
+	std::vector<VoxelGrid::Chunk*> gridChunks;
+	std::vector<uint64_t> freedChunks;
+	std::vector<std::pair<VoxelGrid::Chunk*, std::unordered_map<int, StaticMesh>*>> dirtyChunks;
 
 	void Update(int activeScene, float deltaTime);
 
-	void AddComponent(Component* component);
+	// Rebuilds every scene's mesh for a chunk.
+	void BuildChunkMeshes(const VoxelGrid::Chunk& chunk, std::unordered_map<int, StaticMesh>& meshes);
 
-	void PurgeEntity(Entity* e);
+	// Greedy meshing: neighbouring exposed faces that look the same are merged into one rectangle.
+	// tags has each face of each cell's look, or -1 where there's nothing to draw.
+	void MergeFaces(const VoxelGrid::Chunk& chunk, const std::vector<CubeFace>& looks, const std::vector<int16_t>& tags, StaticMesh& mesh);
 };
 
-class AnimationSystem : public System
+class AnimationControllerSystem
 {
 public:
-	std::vector<AnimationComponent*> anims;
+	static constexpr uint32_t reads = ComponentSignature<AnimationControllerComponent>();
+	static constexpr uint32_t writes = 0;
+	static constexpr bool mainThread = false;
 
-	void Update(int activeScene, float deltaTime);
+	Query<AnimationControllerComponent> query;
 
-	void AddComponent(Component* component);
-
-	void PurgeEntity(Entity* e);
+	void Update(int activeScene, float deltaTime);
 };
 
-class CameraFollowSystem : public System
+class AnimationSystem
 {
 public:
-	std::vector<CameraFollowComponent*> cams;
-
-	void Update(int activeScene, float deltaTime);
+	static constexpr uint32_t reads = ComponentSignature<PositionComponent>();
+	static constexpr uint32_t writes = ComponentSignature<AnimationComponent>();
+	static constexpr bool mainThread = false;
 
-	void AddComponent(Component* component);
+	Query<AnimationComponent, PositionComponent> query;
+	std::vector<RenderBuffer> renderBuffers;
 
-	void PurgeEntity(Entity* e);
+	void Update(int activeScene, float deltaTime);
 };
 
-class InputSystem : public System
+class CameraFollowSystem
 {
 public:
-	std::vector<InputComponent*> inputs;
-
-	void Update(int activeScene, float deltaTime);
+	static constexpr uint32_t reads = ComponentSignature<CameraFollowComponent, PositionComponent>();
+	static constexpr uint32_t writes = cameraAccess;
+	static constexpr bool mainThread = false;
 
-	void AddComponent(Component* component);
+	Query<CameraFollowComponent, PositionComponent> query;
 
-	void PurgeEntity(Entity* e);
+	void Update(int activeScene, float deltaTime);
 };
 
-class BillboardingSystem : public System
+class InputSystem
 {
 public:
-	std::vector<BillboardingComponent*> boards;
-
-	void Update(int activeScene, float deltaTime);
+	static constexpr uint32_t reads = allAccess;
+	static constexpr uint32_t writes = allAccess;
+	static constexpr bool mainThread = true;
 
-	void AddComponent(Component* component);
+	Query<InputComponent, ActorComponent, MovementComponent> query;
 
-	void PurgeEntity(Entity* e);
+	void Update(int activeScene, float deltaTime);
 };
 
-class TurnSystem : public System
+class BillboardingSystem
 {
-	std::vector<ActorComponent*> actors;
+public:
+	static constexpr uint32_t reads = ComponentSignature<BillboardingComponent>() | cameraAccess;
+	static constexpr uint32_t writes = ComponentSignature<PositionComponent>();
+	static constexpr bool mainThread = false;
+
+	Query<BillboardingComponent, PositionComponent> query;
 
 	void Update(int activeScene, float deltaTime);
+};
+
+class TurnSystem
+{
+public:
+	static constexpr uint32_t reads = ComponentSignature<ActorComponent>();
+	static constexpr uint32_t writes = 0;
+	static constexpr bool mainThread = false;
 
-	void AddComponent(Component* component);
+	Query<ActorComponent> query;
 
-	void PurgeEntity(Entity* e);
+	void Update(int activeScene, float deltaTime);
 };
 
-class MovementSystem : public System
+class MovementSystem
 {
-	std::vector<MovementComponent*> movers;
+public:
+	static constexpr uint32_t reads = 0;
+	static constexpr uint32_t writes = ComponentSignature<MovementComponent, PositionComponent, CubeComponent>() | gridAccess;	// The grid's moving bits, and the face masks around them.
+	static constexpr bool mainThread = false;
 
-	void Update(int activeScene, float deltaTime);
+	static const int chunkSize = 256;
 
-	void AddComponent(Component* component);
+	Query<MovementComponent, PositionComponent> query;
+	std::vector<std::vector<MovementComponent*>> stopped;	// Per chunk; movers that came to rest this frame.
 
-	void PurgeEntity(Entity* e);
+	void Update(int activeScene, float deltaTime);
 };
 
-class ModelSystem : public System
+class ModelSystem
 {
-	std::vector<ModelComponent*> models;
-
-	void Update(int activeScene, float deltaTime);
+public:
+	static constexpr uint32_t reads = ComponentSignature<ModelComponent, PositionComponent>();
+	static constexpr uint32_t writes = 0;
+	static constexpr bool mainThread = false;
 
-	void AddComponent(Component* component);
+	Query<ModelComponent, PositionComponent> query;
+	std::vector<RenderBuffer> renderBuffers;
 
-	void PurgeEntity(Entity* e);
+	void Update(int activeScene, float deltaTime);
 };
 
 #endif
\ No newline at end of file
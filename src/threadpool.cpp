@@ -0,0 +1,151 @@
+#include "threadpool.h"
+
+// Defined here rather than with the other singletons in main.cpp, so the sim library has it without the game.
+ThreadPool ThreadPool::main;
+
+thread_local int ThreadPool::workerIndex = -1;
+
+ThreadPool::~ThreadPool()
+{
+	Stop();
+}
+
+void ThreadPool::Start(int threadCount)
+{
+	if (running) return;
+
+	if (threadCount < 0) threadCount = 0;
+
+	queues.clear();
+	for (int i = 0; i < threadCount + 1; i++)
+	{
+		queues.push_back(std::make_unique<WorkQueue>());
+	}
+
+	running = true;
+
+	for (int i = 0; i < threadCount; i++)
+	{
+		threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+	}
+}
+
+void ThreadPool::Stop()
+{
+	if (!running) return;
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		running = false;
+	}
+	wake.notify_all();
+
+	for (int i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+
+	threads.clear();
+	queues.clear();
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+	// Without workers (or before Start) there is nobody to hand the task to.
+	if (threads.size() == 0)
+	{
+		task();
+		return;
+	}
+
+	// Workers keep what they spawn; everyone else shares the last queue.
+	int queue = workerIndex >= 0 ? workerIndex : (int)queues.size() - 1;
+
+	{
+		std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+		queues[queue]->tasks.push_back(std::move(task));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		queuedTasks++;
+	}
+	wake.notify_one();
+}
+
+bool ThreadPool::RunOne()
+{
+	if (threads.size() == 0) return false;
+
+	std::function<void()> task;
+	int self = workerIndex >= 0 ? workerIndex : (int)queues.size() - 1;
+
+	if (Pop(self, task) || Steal(self, task))
+	{
+		task();
+		return true;
+	}
+
+	return false;
+}
+
+int ThreadPool::ThreadCount() const
+{
+	return (int)threads.size();
+}
+
+bool ThreadPool::Pop(int queue, std::function<void()>& task)
+{
+	WorkQueue& q = *queues[queue];
+	std::lock_guard<std::mutex> lock(q.mutex);
+
+	if (q.tasks.size() == 0) return false;
+
+	task = std::move(q.tasks.back());
+	q.tasks.pop_back();
+	queuedTasks--;
+
+	return true;
+}
+
+bool ThreadPool::Steal(int thief, std::function<void()>& task)
+{
+	int n = (int)queues.size();
+
+	for (int i = 1; i < n; i++)
+	{
+		WorkQueue& q = *queues[(thief + i) % n];
+		std::lock_guard<std::mutex> lock(q.mutex);
+
+		if (q.tasks.size() == 0) continue;
+
+		task = std::move(q.tasks.front());
+		q.tasks.pop_front();
+		queuedTasks--;
+
+		return true;
+	}
+
+	return false;
+}
+
+void ThreadPool::WorkerLoop(int index)
+{
+	workerIndex = index;
+
+	while (true)
+	{
+		std::function<void()> task;
+
+		if (Pop(index, task) || Steal(index, task))
+		{
+			task();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [this] { return !running || queuedTasks > 0; });
+
+		if (!running) return;
+	}
+}
@@ -0,0 +1,94 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads, each with its own task deque.
+// Workers take from the back of their own deque and, when it runs dry, steal from
+// the front of everyone else's, so a thread that spawns work keeps it warm in cache
+// while idle threads pick up the slack.
+class ThreadPool
+{
+public:
+	static ThreadPool main;
+
+	ThreadPool() = default;
+	~ThreadPool();
+
+	void Start(int threadCount);
+	void Stop();
+
+	void Submit(std::function<void()> task);
+
+	// Runs one queued task on the calling thread, if there is one.
+	// Threads that are waiting on submitted work call this instead of blocking.
+	bool RunOne();
+
+	int ThreadCount() const;
+
+	// Calls f(chunk, begin, end) for each chunkSize-wide slice of [0, count).
+	// The slices depend only on count and chunkSize, never on which thread runs them,
+	// so per-chunk output can be merged back in chunk order for a deterministic result.
+	// The calling thread takes the first chunk itself and helps with the rest until all are done.
+	template <typename F>
+	void ParallelFor(int count, int chunkSize, F&& f)
+	{
+		if (count <= 0) return;
+
+		int chunks = (count + chunkSize - 1) / chunkSize;
+		std::atomic<int> chunksLeft{ chunks };
+
+		for (int c = 1; c < chunks; c++)
+		{
+			Submit([&f, &chunksLeft, c, count, chunkSize]
+			{
+				int begin = c * chunkSize;
+				int end = begin + chunkSize < count ? begin + chunkSize : count;
+
+				f(c, begin, end);
+				chunksLeft--;
+			});
+		}
+
+		f(0, 0, chunkSize < count ? chunkSize : count);
+		chunksLeft--;
+
+		while (chunksLeft > 0)
+		{
+			if (!RunOne()) std::this_thread::yield();
+		}
+	}
+
+private:
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	// One queue per worker, plus a shared one at the end for threads outside the pool.
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::vector<std::thread> threads;
+
+	std::atomic<bool> running{ false };
+	std::atomic<int> queuedTasks{ 0 };
+
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+
+	static thread_local int workerIndex;
+
+	bool Pop(int queue, std::function<void()>& task);
+	bool Steal(int thief, std::function<void()>& task);
+
+	void WorkerLoop(int index);
+};
+
+#endif
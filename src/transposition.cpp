@@ -0,0 +1,126 @@
+#include "transposition.h"
+
+#include <algorithm>
+#include <cstring>
+
+void TranspositionTable::Reset(size_t memoryBytes, size_t recordBytes)
+{
+	// About this many states fit, counting a record and a slot and a third each.
+	size_t states = memoryBytes / (recordBytes + 11);
+
+	size_t slotCount = 1024;
+	while (slotCount * 3 / 4 < states && slotCount * 2 * sizeof(uint64_t) <= memoryBytes / 2) slotCount *= 2;
+
+	slots = std::make_unique<std::atomic<uint64_t>[]>(slotCount);
+	slotMask = slotCount - 1;
+	maxCount = slotCount * 3 / 4;
+	count = 0;
+
+	// Offsets only have so many bits; past that, records couldn't be named.
+	arenaSize = std::min<size_t>(memoryBytes > slotCount * sizeof(uint64_t) ? memoryBytes - slotCount * sizeof(uint64_t) : 0, offsetMask);
+	arena.reset(new uint8_t[arenaSize]);
+
+	// Offset 0 is kept back, so that an empty slot can be all zeroes.
+	arenaUsed = 1;
+}
+
+void TranspositionTable::Clear()
+{
+	slots.reset();
+	slotMask = 0;
+	maxCount = 0;
+	count = 0;
+
+	arena.reset();
+	arenaSize = 0;
+	arenaUsed = 0;
+}
+
+TranspositionTable::InsertResult TranspositionTable::Insert(uint64_t hash, const uint8_t* packed, uint32_t keyLength, uint32_t length, uint64_t parent, uint8_t move, uint64_t& record)
+{
+	uint64_t fingerprint = hash >> offsetBits;
+	uint64_t reserved = noRecord;
+
+	size_t i = (size_t)hash & slotMask;
+
+	for (size_t probe = 0; probe <= slotMask; probe++, i = (i + 1) & slotMask)
+	{
+		uint64_t slot = slots[i].load(std::memory_order_acquire);
+
+		while (slot == 0)
+		{
+			if (reserved == noRecord)
+			{
+				if (count.load(std::memory_order_relaxed) >= maxCount) return InsertResult::full;
+
+				size_t size = RecordSize(length);
+				size_t offset = arenaUsed.fetch_add(size, std::memory_order_relaxed);
+				if (offset + size > arenaSize) return InsertResult::full;
+
+				uint8_t* r = arena.get() + offset;
+				memcpy(r, &hash, 8);
+				memcpy(r + 8, &parent, 8);
+				r[16] = move;
+				memcpy(r + 17, &keyLength, 4);
+				memcpy(r + 21, &length, 4);
+				memcpy(r + headerSize, packed, length);
+
+				reserved = offset;
+			}
+
+			// On failure slot is reloaded with whatever beat us to it, which might be this very state.
+			if (slots[i].compare_exchange_strong(slot, (fingerprint << offsetBits) | reserved, std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				count.fetch_add(1, std::memory_order_relaxed);
+				record = reserved;
+				return InsertResult::added;
+			}
+		}
+
+		if ((slot >> offsetBits) == fingerprint && Matches(slot & offsetMask, hash, packed, keyLength)) return InsertResult::present;
+	}
+
+	return InsertResult::full;
+}
+
+uint64_t TranspositionTable::Hash(uint64_t record) const
+{
+	uint64_t hash;
+	memcpy(&hash, arena.get() + record, 8);
+	return hash;
+}
+
+uint64_t TranspositionTable::Parent(uint64_t record) const
+{
+	uint64_t parent;
+	memcpy(&parent, arena.get() + record + 8, 8);
+	return parent;
+}
+
+uint8_t TranspositionTable::Move(uint64_t record) const
+{
+	return arena[record + 16];
+}
+
+uint32_t TranspositionTable::KeyLength(uint64_t record) const
+{
+	uint32_t keyLength;
+	memcpy(&keyLength, arena.get() + record + 17, 4);
+	return keyLength;
+}
+
+const uint8_t* TranspositionTable::Packed(uint64_t record) const
+{
+	return arena.get() + record + headerSize;
+}
+
+const uint8_t* TranspositionTable::Extra(uint64_t record) const
+{
+	return Packed(record) + KeyLength(record);
+}
+
+bool TranspositionTable::Matches(uint64_t record, uint64_t hash, const uint8_t* packed, uint32_t keyLength) const
+{
+	// Packed states are canonical, so equal states have equal bytes.
+	return Hash(record) == hash && KeyLength(record) == keyLength && memcmp(Packed(record), packed, keyLength) == 0;
+}
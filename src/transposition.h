@@ -0,0 +1,72 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// The solver's record of every state it has reached, shared by all of its threads without locks.
+//
+// States live as records in one big arena: the state's hash, the record of the state it was reached
+// from, the move that got there, and the state's packed bytes (see PuzzleState::Pack). Records are
+// appended by bumping an atomic offset and never move or go away, so a record's offset names its state
+// for the rest of the search.
+//
+// The slots are an open-addressed hash table of 64-bit words, probed linearly from the state's hash:
+// the top bits of the hash as a fingerprint, and the offset of the record. A record is written in full
+// before its slot is claimed with a compare-and-swap, so anyone who can see a slot can read its record.
+// Two threads adding the same state at once both write a record, one wins the slot and the other's
+// record is simply never pointed at.
+//
+// Everything is sized up front from a memory budget; when it runs out, Insert says so rather than growing.
+class TranspositionTable
+{
+public:
+	static const uint64_t noRecord = ~0ull;
+
+	enum class InsertResult { added, present, full };
+
+	// Splits memoryBytes between slots and arena, for states whose records are around recordBytes
+	// (RecordSize of a typical packed state). Keeps the slots at most 3/4 full.
+	void Reset(size_t memoryBytes, size_t recordBytes);
+
+	// Gives all of the memory back.
+	void Clear();
+
+	// Adds a state unless an equal one is already here. record is set to the new record's offset when added.
+	// Only the first keyLength of the packed bytes are compared; anything after that is kept with the
+	// record but is up to the caller.
+	InsertResult Insert(uint64_t hash, const uint8_t* packed, uint32_t keyLength, uint32_t length, uint64_t parent, uint8_t move, uint64_t& record);
+
+	uint64_t Count() const { return count.load(std::memory_order_relaxed); }
+
+	uint64_t Hash(uint64_t record) const;
+	uint64_t Parent(uint64_t record) const;
+	uint8_t Move(uint64_t record) const;
+	const uint8_t* Packed(uint64_t record) const;
+	const uint8_t* Extra(uint64_t record) const;	// Whatever came after the key.
+
+	static size_t RecordSize(uint32_t length) { return headerSize + length; }
+
+private:
+	// hash (8), parent (8), move (1), key length (4), length (4).
+	static const size_t headerSize = 25;
+
+	static const int offsetBits = 36;
+	static const uint64_t offsetMask = (1ull << offsetBits) - 1;
+
+	std::unique_ptr<std::atomic<uint64_t>[]> slots;
+	size_t slotMask = 0;
+	uint64_t maxCount = 0;
+	std::atomic<uint64_t> count{ 0 };
+
+	std::unique_ptr<uint8_t[]> arena;
+	size_t arenaSize = 0;
+	std::atomic<size_t> arenaUsed{ 0 };
+
+	uint32_t KeyLength(uint64_t record) const;
+	bool Matches(uint64_t record, uint64_t hash, const uint8_t* packed, uint32_t keyLength) const;
+};
+
+#endif
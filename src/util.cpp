@@ -1,7 +1,10 @@
+// MSVC only defines M_PI and friends when asked, before anything brings in <cmath>.
+#define _USE_MATH_DEFINES
+
 #include "util.h"
-#include "component.h"
 
-#include <corecrt_math_defines.h>
+#include <cmath>
+#include <math.h>
 #include <iostream>
 #include <glm/gtx/norm.hpp>
 #include <algorithm>
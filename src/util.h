@@ -2,10 +2,38 @@
 #define UTIL_H
 
 #include <glm/glm.hpp>
+#include <vector>
 
-enum class Face;
-enum class Corner;
-struct Quaternion;
+enum class Face { front, back, left, right, top, bottom };
+enum class Corner { left, bottom, right, top };
+
+struct Quaternion
+{
+	float w;
+	float x;
+	float y;
+	float z;
+
+	Quaternion operator*(const Quaternion& rhs) const noexcept
+	{
+		Quaternion q = { 0, 0, 0, 0 };
+		q.w = (this->w * rhs.w - this->x * rhs.x - this->y * rhs.y - this->z * rhs.z);
+		q.x = (this->w * rhs.x + this->x * rhs.w + this->y * rhs.z - this->z * rhs.y);
+		q.y = (this->w * rhs.y - this->x * rhs.z + this->y * rhs.w + this->z * rhs.x);
+		q.z = (this->w * rhs.z + this->x * rhs.y - this->y * rhs.x + this->z * rhs.w);
+		return q;
+	}
+
+	bool operator==(const Quaternion& rhs) const noexcept
+	{
+		return ((this->w == rhs.w) && (this->x == rhs.x) && (this->y == rhs.y) && (this->z == rhs.z));
+	}
+
+	Quaternion operator-() const noexcept
+	{
+		return Quaternion{ -this->w, -this->x, -this->y, -this->z };
+	}
+};
 
 class Util
 {
@@ -42,4 +70,62 @@ public:
 	static Quaternion GetRollRotation(Face activeFace, Face rollDirection, Quaternion baseQuaternion, int turns);
 };
 
+struct BezierCurve
+{
+	std::vector<glm::vec3> points;
+
+	glm::vec3 GetPoint(float t)
+	{
+		std::vector<glm::vec3> ps = points;
+		std::vector<glm::vec3> tmp;
+
+		for (int i = 0; i < points.size(); i++)
+		{
+			for (int j = 0; j < ps.size() - 1; j++)
+			{
+				tmp.push_back(Util::Lerp(ps[j], ps[j + 1], t));
+			}
+
+			ps = tmp;
+			tmp.clear();
+
+			if (ps.size() == 1)
+			{
+				return ps[0];
+			}
+		}
+
+		return glm::vec3(0.0f, 0.0f, 0.0f);
+	}
+};
+
+struct BezierQuaternion
+{
+	std::vector<Quaternion> rotations;
+
+	Quaternion GetQuaternion(float t)
+	{
+		std::vector<Quaternion> qs = rotations;
+		std::vector<Quaternion> tmp;
+
+		for (int i = 0; i < rotations.size(); i++)
+		{
+			for (int j = 0; j < qs.size() - 1; j++)
+			{
+				tmp.push_back(Util::Slerp(qs[j], qs[j + 1], t));
+			}
+
+			qs = tmp;
+			tmp.clear();
+
+			if (qs.size() == 1)
+			{
+				return qs[0];
+			}
+		}
+
+		return { 1.0f, 0.0f, 0.0f, 0.0f };
+	}
+};
+
 #endif
\ No newline at end of file